@@ -6,33 +6,34 @@
 
 #include "sensor_msgs/Imu.h"
 #include "sensor_msgs/PointCloud.h"
+#include "sensor_msgs/Image.h"
+#include "sensor_msgs/image_encodings.h"
+#include "cv_bridge/cv_bridge.h"
+#include "vins_msgs/FeatureFrame.h"
 
 #include "data_generator.h"
 
 #include <opencv2/core/core.hpp>
-#include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
 using namespace std;
 using namespace Eigen;
 
 
-#define ROW 480
-#define COL 752
-
-
 int main(int argc, char** argv)
 {
     ros::init(argc, argv, "data_generator");
     ros::NodeHandle n;
 
     ros::Publisher pub_imu      = n.advertise<sensor_msgs::Imu>("/imu_3dm_gx4/imu", 1000);
-    ros::Publisher pub_image    = n.advertise<sensor_msgs::PointCloud>("/sensors/image", 1000);
+    ros::Publisher pub_image    = n.advertise<vins_msgs::FeatureFrame>("/sensors/image", 1000);
 
     ros::Publisher pub_path     = n.advertise<nav_msgs::Path>("/simulation/path", 100);
     ros::Publisher pub_odometry = n.advertise<nav_msgs::Odometry>("/simulation/odometry", 100);
     ros::Publisher pub_pose     = n.advertise<geometry_msgs::PoseStamped>("/simulation/pose", 100);
     ros::Publisher pub_cloud    = n.advertise<sensor_msgs::PointCloud>("/simulation/cloud", 1000);
+    // feature ids drawn at their image position, only when someone listens
+    ros::Publisher pub_sim_image = n.advertise<sensor_msgs::Image>("/simulation/image", 10);
 
     DataGenerator generator;
     ros::Rate loop_rate(generator.FREQ);
@@ -53,8 +54,6 @@ int main(int argc, char** argv)
     }
     pub_cloud.publish(point_cloud);
 
-    cv::namedWindow("camera image", cv::WINDOW_AUTOSIZE);
-
     int publish_count = 0;
 
     nav_msgs::Path path;
@@ -124,43 +123,40 @@ int main(int argc, char** argv)
             //publish image data
             //ROS_INFO("feature count: %lu", generator.getImage().size());
 
-            sensor_msgs::PointCloud feature;
-            sensor_msgs::ChannelFloat32 ids;
-            sensor_msgs::ChannelFloat32 pixel;
-            for (int i = 0; i < ROW; i++)
-                for (int j = 0; j < COL; j++)
-                    pixel.values.push_back(255);
+            vins_msgs::FeatureFrame feature;
             feature.header.stamp = ros::Time(generator.getTime());
-            cv::Mat simu_img(600, 600, CV_8UC3, cv::Scalar(0, 0, 0));
+            bool draw = pub_sim_image.getNumSubscribers() > 0;
+            cv::Mat simu_img;
+            if (draw)
+                simu_img = cv::Mat(600, 600, CV_8UC3, cv::Scalar(0, 0, 0));
             for (auto & id_pts : generator.getImage())
             {
                 int id = id_pts.first;
-                geometry_msgs::Point32 p;
-                p.x = id_pts.second(0);
-                p.y = id_pts.second(1);
-                p.z = id_pts.second(2);
-
-                //project point
-                //p.y /= p.x;
-                //p.z /= p.x;
-                //p.x = 1;
-
-                feature.points.push_back(p);
-                ids.values.push_back(id);
-
-                p.x /= p.z;
-                p.y /= p.z;
-
-                char label[10];
-                sprintf(label, "%d", id);
-                cv::putText(simu_img, label, cv::Point2d(p.y + 1, p.x + 1) * 0.5 * 600, cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 255));
+                // points are in front of the camera, send them on the normalized plane
+                double x = id_pts.second(0) / id_pts.second(2);
+                double y = id_pts.second(1) / id_pts.second(2);
+
+                feature.ids.push_back(id);
+                feature.x.push_back(x);
+                feature.y.push_back(y);
+
+                if (draw)
+                {
+                    char label[10];
+                    sprintf(label, "%d", id);
+                    cv::putText(simu_img, label, cv::Point2d(y + 1, x + 1) * 0.5 * 600, cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 255));
+                }
             }
-            feature.channels.push_back(ids);
-            feature.channels.push_back(pixel);
             pub_image.publish(feature);
             ROS_INFO("publish image data with stamp %lf", feature.header.stamp.toSec());
-            cv::imshow("camera image", simu_img);
-            cv::waitKey(100);
+            if (draw)
+            {
+                cv_bridge::CvImage sim_image;
+                sim_image.header = feature.header;
+                sim_image.encoding = sensor_msgs::image_encodings::BGR8;
+                sim_image.image = simu_img;
+                pub_sim_image.publish(sim_image.toImageMsg());
+            }
             //if (generator.getTime() > DataGenerator::MAX_TIME)
             //    break;
         }
@@ -0,0 +1,135 @@
+//
+//  camera_benchmark.cpp
+//  msckf_vins
+//
+//  per camera model: projection throughput single point vs batch,
+//  and pixel -> normalized plane lifting, iterative vs undistort map
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <Eigen/Dense>
+
+#include "Camera.h"
+#include "EquidistantCamera.h"
+#include "OmniCamera.h"
+#include "tic_toc.h"
+
+using namespace Eigen;
+
+const int NUM_POINTS = 1000;
+const int NUM_ROUNDS = 2000;
+
+template<typename Camera>
+void benchmark(Camera &cam, const ArrayXd &x, const ArrayXd &y, const ArrayXd &z)
+{
+    ArrayXd px, py;
+    Array<bool, Dynamic, 1> in_image;
+    Array<double, Dynamic, 6> J;
+    Vector2d zi;
+    Matrix<double, 2, 3> Ji;
+    double checksum = 0.0;
+
+    TicToc t_h;
+    for (int k = 0; k < NUM_ROUNDS; k++)
+        for (int i = 0; i < NUM_POINTS; i++)
+            checksum += cam.h(Vector3d(x(i), y(i), z(i)))(0);
+    double cost_h = t_h.toc();
+
+    TicToc t_hj;
+    for (int k = 0; k < NUM_ROUNDS; k++)
+        for (int i = 0; i < NUM_POINTS; i++)
+        {
+            cam.projectWithJacobian(Vector3d(x(i), y(i), z(i)), zi, Ji);
+            checksum += zi(0) + Ji(0, 0);
+        }
+    double cost_hj = t_hj.toc();
+
+    TicToc t_batch;
+    for (int k = 0; k < NUM_ROUNDS; k++)
+    {
+        cam.projectPoints(x, y, z, px, py, in_image);
+        checksum += px(k % NUM_POINTS);
+    }
+    double cost_batch = t_batch.toc();
+
+    TicToc t_batch_j;
+    for (int k = 0; k < NUM_ROUNDS; k++)
+    {
+        cam.projectPoints(x, y, z, px, py, in_image, &J);
+        checksum += px(k % NUM_POINTS) + J(k % NUM_POINTS, 0);
+    }
+    double cost_batch_j = t_batch_j.toc();
+
+    // only lift what lands in the image
+    std::vector<Vector2d> uv;
+    for (int i = 0; i < NUM_POINTS; i++)
+        if (in_image(i))
+            uv.push_back(Vector2d(px(i), py(i)));
+    int num_uv = (int)uv.size();
+
+    UndistortMap undistort_map;
+    undistort_map.build(cam, 4);
+    cam.setUndistortMap(&undistort_map);
+
+    double max_err = 0.0, max_reproj = 0.0;
+    for (int i = 0; i < num_uv; i++)
+    {
+        Vector2d xy = cam.undistortPoint(uv[i]);
+        max_err = std::max(max_err, (cam.liftPoint(uv[i]) - xy).norm());
+        max_reproj = std::max(max_reproj, (cam.h(Vector3d(xy(0), xy(1), 1.0)) - uv[i]).norm());
+    }
+
+    TicToc t_undistort;
+    for (int k = 0; k < NUM_ROUNDS; k++)
+        for (int i = 0; i < num_uv; i++)
+            checksum += cam.undistortPoint(uv[i])(0);
+    double cost_undistort = t_undistort.toc();
+
+    TicToc t_lift;
+    for (int k = 0; k < NUM_ROUNDS; k++)
+        for (int i = 0; i < num_uv; i++)
+            checksum += cam.liftPoint(uv[i])(0);
+    double cost_lift = t_lift.toc();
+    cam.setUndistortMap(NULL);
+
+    double total = (double)NUM_POINTS * NUM_ROUNDS;
+    double total_uv = (double)num_uv * NUM_ROUNDS;
+    printf("[%s] points in image: %d / %d\n", Camera::name(), num_uv, NUM_POINTS);
+    printf("h                    %8.2f Mpts/s\n", total / cost_h / 1e3);
+    printf("projectWithJacobian  %8.2f Mpts/s\n", total / cost_hj / 1e3);
+    printf("projectPoints        %8.2f Mpts/s\n", total / cost_batch / 1e3);
+    printf("projectPoints + J    %8.2f Mpts/s\n", total / cost_batch_j / 1e3);
+    printf("undistortPoint       %8.2f Mpts/s, max reprojection error %g px\n", total_uv / cost_undistort / 1e3, max_reproj);
+    printf("liftPoint (map)      %8.2f Mpts/s, max error %g\n", total_uv / cost_lift / 1e3, max_err);
+    printf("checksum %lf\n\n", checksum);
+}
+
+int main(int argc, char **argv)
+{
+    srand(0);
+    ArrayXd x = ArrayXd::Random(NUM_POINTS);
+    ArrayXd y = ArrayXd::Random(NUM_POINTS) * 0.7;
+    ArrayXd z = ArrayXd::Random(NUM_POINTS) + 2.0;
+
+    DistortCamera radtan;
+    radtan.setImageSize(480, 752);
+    radtan.setIntrinsicMtx(365.07984, 365.12127, 381.0196, 254.4431);
+    radtan.setDistortionParam(-2.842958e-1, 8.7155025e-2, -1.4602925e-4, -6.149638e-4, -1.218237e-2);
+    benchmark(radtan, x, y, z);
+
+    EquidistantCamera equidistant;
+    equidistant.setImageSize(480, 752);
+    equidistant.setIntrinsicMtx(250.0, 250.0, 376.0, 240.0);
+    equidistant.setDistortionParam({-1.2e-2, 4.5e-3, -3.1e-3, 6.0e-4});
+    benchmark(equidistant, x, y, z);
+
+    OmniCamera omni;
+    omni.setImageSize(480, 752);
+    omni.setIntrinsicMtx(700.0, 700.0, 376.0, 240.0);
+    omni.setDistortionParam({1.2, -0.25, 0.08, 1.0e-4, -2.0e-4});
+    benchmark(omni, x, y, z);
+
+    return 0;
+}
@@ -8,22 +8,12 @@
 
 #ifndef MyTriangulation_Camera_h
 #define MyTriangulation_Camera_h
+#include <vector>
 #include <Eigen/Dense>
+#include "CameraModel.h"
 
-class DistortCamera {
-    int width;
-    int height;
-    int nRows;
-    int nCols;
-    
-    double fx;
-    double fy;
-    
-    double ox;
-    double oy;
-    
-    double focus_length;
-    
+// pinhole with opencv radial-tangential distortion
+class DistortCamera : public CameraModel<DistortCamera> {
     // distortion parameters, opencv k1, k2, p1, p2, k3
     double k1;
     double k2;
@@ -31,21 +21,43 @@ class DistortCamera {
     double p2;
     double k3;
     
-    Eigen::Matrix3d K;
-    Eigen::Vector2d optical;
-    Eigen::Matrix2d focusMtx;
-    
 public:
+    static const int NUM_DISTORTION_PARAM = 5;
+    static const char *name() { return "radtan"; }
+    
     DistortCamera();
-    void setImageSize(double _height, double _width);
-    void setIntrinsicMtx(double _fx, double _fy, double _ox, double _oy);
     void setDistortionParam(double _k1, double _k2, double _p1, double _p2, double _k3);
-    
-    Eigen::Vector2d h(Eigen::Vector3d ptr);
-    
-    Eigen::MatrixXd Jh(Eigen::Vector3d ptr);
-    
-    Eigen::Vector3d triangulate(Eigen::MatrixXd measure, Eigen::MatrixXd pose);
+    bool setDistortionParam(const std::vector<double> &params);   // k1, k2, p1, p2, k3
+    std::vector<double> getDistortionParam() const;
+    
+    void spaceToPlane(const Eigen::Vector3d &ptr, Eigen::Vector2d &m, Eigen::Matrix<double, 2, 3> *J) const
+    {
+        double inv_z = 1.0/ptr(2);
+        double u = ptr(0)*inv_z;
+        double v = ptr(1)*inv_z;
+        
+        if (J == NULL)
+        {
+            distortRadTan(k1, k2, p1, p2, k3, u, v, m, NULL);
+            return;
+        }
+        
+        // chain with d(u, v)/d(x, y, z)
+        Eigen::Matrix2d Jd;
+        distortRadTan(k1, k2, p1, p2, k3, u, v, m, &Jd);
+        J->leftCols<2>() = Jd*inv_z;
+        J->col(2) = -(Jd.col(0)*u + Jd.col(1)*v)*inv_z;
+    }
+    
+    Eigen::Vector2d planeToSpace(const Eigen::Vector2d &m) const
+    {
+        return undistortRadTan(k1, k2, p1, p2, k3, m);
+    }
+    
+    // vectorized over the whole batch, same interface as CameraModel::projectPoints
+    void projectPoints(const Eigen::ArrayXd &x, const Eigen::ArrayXd &y, const Eigen::ArrayXd &z,
+                       Eigen::ArrayXd &px, Eigen::ArrayXd &py, Eigen::Array<bool, Eigen::Dynamic, 1> &in_image,
+                       Eigen::Array<double, Eigen::Dynamic, 6> *J = NULL) const;
 };
 
 #endif
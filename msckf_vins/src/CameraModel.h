@@ -0,0 +1,321 @@
+//
+//  CameraModel.h
+//  msckf_vins
+//
+//  common part of the camera models. The model specific part lives in the
+//  derived class (CRTP) and provides
+//
+//      void spaceToPlane(const Vector3d &P, Vector2d &m, Matrix<double, 2, 3> *J) const;
+//          camera frame point -> distorted normalized coordinate, and dm/dP if J is not NULL
+//      Vector2d planeToSpace(const Vector2d &m) const;
+//          distorted normalized coordinate -> undistorted normalized image plane (z = 1)
+//      bool setDistortionParam(const std::vector<double> &params);
+//      std::vector<double> getDistortionParam() const;
+//
+//  so h, Jh and projectWithJacobian are resolved at compile time and inline
+//  into the filter, there is no virtual call on the measurement path.
+//
+
+#ifndef __msckf_vins__CameraModel__
+#define __msckf_vins__CameraModel__
+
+#include <cmath>
+#include <vector>
+#include <Eigen/Dense>
+#include "UndistortMap.h"
+#include "math_tool.h"
+
+// opencv radial-tangential distortion of a normalized point (u, v),
+// Jd (optional) is d(md)/d(u, v)
+inline void distortRadTan(double k1, double k2, double p1, double p2, double k3,
+                          double u, double v, Eigen::Vector2d &md, Eigen::Matrix2d *Jd)
+{
+    double uv = u*v;
+    double r = u*u + v*v;
+    double dr = 1 + r*(k1 + r*(k2 + r*k3));
+
+    md(0) = dr*u + 2*uv*p1 + (r+2*u*u)*p2;
+    md(1) = dr*v + 2*uv*p2 + (r+2*v*v)*p1;
+
+    if (Jd != NULL)
+    {
+        double ddr = k1 + r*(2*k2 + r*3*k3);   // d(dr)/dr
+        (*Jd)(0,0) = dr + 2*u*u*ddr + 2*p1*v + 6*p2*u;
+        (*Jd)(0,1) =      2*uv*ddr  + 2*p1*u + 2*p2*v;
+        (*Jd)(1,0) = (*Jd)(0,1);
+        (*Jd)(1,1) = dr + 2*v*v*ddr + 6*p1*v + 2*p2*u;
+    }
+}
+
+// inverse of distortRadTan, same fixed point iteration as cv::undistortPoints
+inline Eigen::Vector2d undistortRadTan(double k1, double k2, double p1, double p2, double k3,
+                                       const Eigen::Vector2d &md)
+{
+    double x, y, r, icdr, dx, dy;
+    x = md(0);
+    y = md(1);
+    for (int i = 0; i < 20; i++)
+    {
+        r = x*x + y*y;
+        icdr = 1/(1 + r*(k1 + r*(k2 + r*k3)));
+        dx = 2*x*y*p1 + (r+2*x*x)*p2;
+        dy = 2*x*y*p2 + (r+2*y*y)*p1;
+        x = (md(0) - dx)*icdr;
+        y = (md(1) - dy)*icdr;
+    }
+    return Eigen::Vector2d(x, y);
+}
+
+template<typename Derived>
+class CameraModel
+{
+protected:
+    int width;
+    int height;
+
+    double fx;
+    double fy;
+
+    double ox;
+    double oy;
+
+    // optional pixel -> normalized plane table, owned by the caller
+    const UndistortMap *undistort_map;
+
+    const Derived &derived() const
+    {
+        return static_cast<const Derived &>(*this);
+    }
+
+public:
+    CameraModel(): width(0), height(0), fx(1), fy(1), ox(0), oy(0), undistort_map(NULL)
+    {}
+
+    void setImageSize(double _height, double _width)
+    {
+        width = _width;
+        height = _height;
+    }
+
+    void setIntrinsicMtx(double _fx, double _fy, double _ox, double _oy)
+    {
+        fx = _fx;
+        fy = _fy;
+        ox = _ox;
+        oy = _oy;
+    }
+
+    void setUndistortMap(const UndistortMap *_undistort_map)
+    {
+        undistort_map = _undistort_map;
+    }
+
+    int getWidth() const
+    {
+        return width;
+    }
+
+    int getHeight() const
+    {
+        return height;
+    }
+
+    // fx, fy, ox, oy followed by the distortion parameters of the model
+    std::vector<double> getParams() const
+    {
+        std::vector<double> params = {fx, fy, ox, oy};
+        std::vector<double> dist = derived().getDistortionParam();
+        params.insert(params.end(), dist.begin(), dist.end());
+        return params;
+    }
+
+    Eigen::Vector2d h(const Eigen::Vector3d &ptr) const
+    {
+        Eigen::Vector2d m;
+        derived().spaceToPlane(ptr, m, NULL);
+        return Eigen::Vector2d(ox + fx*m(0), oy + fy*m(1));
+    }
+
+    Eigen::Matrix<double, 2, 3> Jh(const Eigen::Vector3d &ptr) const
+    {
+        Eigen::Vector2d z;
+        Eigen::Matrix<double, 2, 3> J;
+        projectWithJacobian(ptr, z, J);
+        return J;
+    }
+
+    // projection and its jacobian w.r.t. the camera frame point in one pass,
+    // the model shares its intermediates and nothing is allocated
+    void projectWithJacobian(const Eigen::Vector3d &ptr, Eigen::Vector2d &z, Eigen::Matrix<double, 2, 3> &J) const
+    {
+        Eigen::Vector2d m;
+        derived().spaceToPlane(ptr, m, &J);
+        z(0) = ox + fx*m(0);
+        z(1) = oy + fy*m(1);
+        J.row(0) *= fx;
+        J.row(1) *= fy;
+    }
+
+    // batch projection of camera frame points given as separate x, y, z arrays,
+    // in_image is false for points behind the camera or outside the image,
+    // J (optional) holds one row per point: J00 J01 J02 J10 J11 J12
+    void projectPoints(const Eigen::ArrayXd &x, const Eigen::ArrayXd &y, const Eigen::ArrayXd &z,
+                       Eigen::ArrayXd &px, Eigen::ArrayXd &py, Eigen::Array<bool, Eigen::Dynamic, 1> &in_image,
+                       Eigen::Array<double, Eigen::Dynamic, 6> *J = NULL) const
+    {
+        int n = (int)x.size();
+        px.resize(n);
+        py.resize(n);
+        if (J != NULL)
+            J->resize(n, 6);
+
+        Eigen::Vector2d zi;
+        Eigen::Matrix<double, 2, 3> Ji;
+        for (int i = 0; i < n; i++)
+        {
+            projectWithJacobian(Eigen::Vector3d(x(i), y(i), z(i)), zi, Ji);
+            px(i) = zi(0);
+            py(i) = zi(1);
+            if (J != NULL)
+            {
+                J->row(i).head<3>() = Ji.row(0);
+                J->row(i).tail<3>() = Ji.row(1);
+            }
+        }
+        in_image = (z > 0) && (px > 0) && (px < (double)width) && (py > 0) && (py < (double)height);
+    }
+
+    // pixel -> normalized image plane by inverting the model
+    Eigen::Vector2d undistortPoint(const Eigen::Vector2d &uv) const
+    {
+        return derived().planeToSpace(Eigen::Vector2d((uv(0) - ox)/fx, (uv(1) - oy)/fy));
+    }
+
+    // same as undistortPoint, but served from the undistort map when one is set
+    Eigen::Vector2d liftPoint(const Eigen::Vector2d &uv) const
+    {
+        Eigen::Vector2d xy;
+        if (undistort_map != NULL && undistort_map->lift(uv(0), uv(1), xy))
+        {
+            return xy;
+        }
+        return undistortPoint(uv);
+    }
+
+    // measure is 2f
+    Eigen::Vector3d triangulate(const Eigen::MatrixXd &measure, const Eigen::MatrixXd &pose) const;
+};
+
+template<typename Derived>
+Eigen::Vector3d CameraModel<Derived>::triangulate(const Eigen::MatrixXd &measure, const Eigen::MatrixXd &pose) const
+{
+    using namespace Eigen;
+    Vector3d return_pose = Vector3d(0.0f, 0.0f, 0.0f);
+    int num_item = (int)pose.cols();
+
+    MatrixXd q_list = MatrixXd::Zero(4, num_item);
+    MatrixXd t_list = MatrixXd::Zero(3, num_item);
+
+    Matrix3d R_wc0 = quaternion_to_R(pose.block<4,1>(0,0));
+    Vector3d t_wc0 = pose.block<3,1>(4,0);
+
+    Matrix3d R_wci = Matrix3d::Identity(3, 3);
+    Vector3d t_wci = Vector3d::Zero(3, 1);
+    Matrix3d R_c0ci, R_cic0;
+    Vector3d t_c0ci, t_cic0;
+
+    q_list.col(0) = Vector4d(1,0,0,0);
+    t_list.col(0) = t_wci;
+
+    // TODO: rewrite this piece use quaternion
+    for (int i=1; i<num_item; i++)
+    {
+        R_wci = quaternion_to_R(pose.block<4,1>(0,i));
+        t_wci = pose.block<3,1>(4,i);
+
+        R_c0ci = R_wc0.transpose()*R_wci;
+        t_c0ci = R_wc0.transpose()*(t_wci - t_wc0);
+        R_cic0 = R_c0ci.transpose();
+        t_cic0 = - R_c0ci.transpose()*t_c0ci;
+
+        q_list.col(i) = R_to_quaternion(R_cic0);
+        t_list.col(i) = t_cic0;
+    }
+
+    // obtain init estimation
+    Vector2d mtx_A, mtx_B;
+    Vector3d ptr_i, ptr_j, ti, tj, guess;
+    MatrixXd nK = MatrixXd::Zero(2,3);
+    Matrix3d R_wbi, R_wbj;
+    double depth;
+
+    ptr_i << liftPoint(measure.col(0)), 1;
+    ptr_j << liftPoint(measure.col(1)), 1;
+
+    R_wbi = quaternion_to_R(pose.block<4,1>(0,0));
+    R_wbj = quaternion_to_R(pose.block<4,1>(0,1));
+    ti = pose.block<3,1>(4,0);
+    tj = pose.block<3,1>(4,1);
+
+    nK(0,0) = 1; nK(1,1) = 1;
+    nK(0,2) = - ptr_i(0);
+    nK(1,2) = - ptr_i(1);
+
+    mtx_A = nK*R_wbi.transpose()*R_wbj*ptr_j;
+    mtx_B = nK*R_wbi.transpose()*(ti - tj);
+
+    depth = (mtx_B(0)*mtx_A(0)+mtx_B(1)*mtx_A(1))/(mtx_A(0)*mtx_A(0)+mtx_A(1)*mtx_A(1));
+    guess = R_wbi.transpose()*R_wbj*depth*ptr_j;
+
+
+    //Vector3d theta = Vector3d(1.0f, 1.0f, 1.0f);
+    Vector3d theta = Vector3d(guess(0)/guess(2), guess(1)/guess(2), 1.0/guess(2));
+
+    Vector3d g_ptr = Vector3d(0.0f, 0.0f, 0.0f);
+    VectorXd f = VectorXd::Zero(num_item*2);
+    MatrixXd J = MatrixXd::Zero(num_item*2,3);
+    Matrix3d Jg = Matrix3d::Zero(3,3);
+    Vector2d zi;
+    Matrix<double, 2, 3> Jhi;
+    MatrixXd A;
+    MatrixXd b;
+    for (int itr = 0; itr < 1000; itr++)
+    {
+        Vector3d tmp_theta = Vector3d(theta(0), theta(1), 1);
+        for (int i = 0; i < num_item; i++)
+        {
+            R_cic0 = quaternion_to_R(q_list.col(i));
+            g_ptr = R_cic0*tmp_theta + theta(2)*t_list.col(i);
+
+            projectWithJacobian(g_ptr, zi, Jhi);
+            f.segment(i*2, 2) = measure.col(i) - zi;
+
+            Jg.col(0) = R_cic0.col(0);
+            Jg.col(1) = R_cic0.col(1);
+            Jg.col(2) = t_list.col(i);
+
+            J.block<2,3>(i*2,0) = -Jhi * Jg;
+        }
+
+        if (f.norm() < 1.0f)
+        {
+            break;
+        }
+        A = J.transpose()*J;
+        b = J.transpose()*f;
+
+        //theta = theta - A.ldlt().solve(b);
+        theta = theta - A.colPivHouseholderQr().solve(b);
+
+    }
+
+    return_pose(0) = theta(0)/theta(2);
+    return_pose(1) = theta(1)/theta(2);
+    return_pose(2) = 1.0f/theta(2);
+
+    return_pose = R_wc0*return_pose+t_wc0;
+
+    return return_pose;
+}
+
+#endif /* defined(__msckf_vins__CameraModel__) */
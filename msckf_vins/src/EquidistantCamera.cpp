@@ -0,0 +1,28 @@
+//
+//  EquidistantCamera.cpp
+//  msckf_vins
+//
+
+#include "EquidistantCamera.h"
+using namespace std;
+
+EquidistantCamera::EquidistantCamera()
+{
+    k1 = k2 = k3 = k4 = 0.0;
+}
+
+bool EquidistantCamera::setDistortionParam(const vector<double> &params)
+{
+    if ((int)params.size() != NUM_DISTORTION_PARAM)
+        return false;
+    k1 = params[0];
+    k2 = params[1];
+    k3 = params[2];
+    k4 = params[3];
+    return true;
+}
+
+vector<double> EquidistantCamera::getDistortionParam() const
+{
+    return {k1, k2, k3, k4};
+}
@@ -0,0 +1,91 @@
+//
+//  EquidistantCamera.h
+//  msckf_vins
+//
+//  equidistant (Kannala-Brandt) fisheye model,
+//  theta_d = theta * (1 + k1*theta^2 + k2*theta^4 + k3*theta^6 + k4*theta^8)
+//
+
+#ifndef __msckf_vins__EquidistantCamera__
+#define __msckf_vins__EquidistantCamera__
+
+#include <cmath>
+#include <vector>
+#include <Eigen/Dense>
+#include "CameraModel.h"
+
+class EquidistantCamera : public CameraModel<EquidistantCamera> {
+    double k1;
+    double k2;
+    double k3;
+    double k4;
+    
+public:
+    static const int NUM_DISTORTION_PARAM = 4;
+    static const char *name() { return "equidistant"; }
+    
+    EquidistantCamera();
+    bool setDistortionParam(const std::vector<double> &params);   // k1, k2, k3, k4
+    std::vector<double> getDistortionParam() const;
+    
+    void spaceToPlane(const Eigen::Vector3d &ptr, Eigen::Vector2d &m, Eigen::Matrix<double, 2, 3> *J) const
+    {
+        double x = ptr(0), y = ptr(1), z = ptr(2);
+        double rho2 = x*x + y*y;
+        
+        // close to the optical axis the model is a plain pinhole
+        if (rho2 < 1e-16)
+        {
+            double inv_z = 1.0/z;
+            m(0) = x*inv_z;
+            m(1) = y*inv_z;
+            if (J != NULL)
+            {
+                *J << inv_z, 0, -x*inv_z*inv_z,
+                      0, inv_z, -y*inv_z*inv_z;
+            }
+            return;
+        }
+        
+        double rho = sqrt(rho2);
+        double theta = atan2(rho, z);
+        double theta2 = theta*theta;
+        double theta_d = theta*(1 + theta2*(k1 + theta2*(k2 + theta2*(k3 + theta2*k4))));
+        double s = theta_d/rho;
+        
+        m(0) = s*x;
+        m(1) = s*y;
+        
+        if (J == NULL)
+            return;
+        
+        // s depends on (x, y) through rho and theta, on z through theta only
+        double dtheta_d = 1 + theta2*(3*k1 + theta2*(5*k2 + theta2*(7*k3 + theta2*9*k4)));
+        double r2 = rho2 + z*z;
+        double c = (dtheta_d*z/r2 - s)/rho2;   // ds/dx = c*x, ds/dy = c*y
+        double dsdz = -dtheta_d/r2;
+        
+        *J << s + c*x*x,     c*x*y, dsdz*x,
+                  c*x*y, s + c*y*y, dsdz*y;
+    }
+    
+    Eigen::Vector2d planeToSpace(const Eigen::Vector2d &m) const
+    {
+        double theta_d = m.norm();
+        if (theta_d < 1e-8)
+            return m;
+        
+        // newton on theta_d(theta) starting from the undistorted guess
+        double theta = theta_d;
+        for (int i = 0; i < 10; i++)
+        {
+            double theta2 = theta*theta;
+            double f = theta*(1 + theta2*(k1 + theta2*(k2 + theta2*(k3 + theta2*k4)))) - theta_d;
+            double df = 1 + theta2*(3*k1 + theta2*(5*k2 + theta2*(7*k3 + theta2*9*k4)));
+            theta -= f/df;
+        }
+        return m * (tan(theta)/theta_d);
+    }
+};
+
+#endif /* defined(__msckf_vins__EquidistantCamera__) */
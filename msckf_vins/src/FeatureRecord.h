@@ -23,7 +23,14 @@ class FeatureInformation
 {
     public:
         Vector3d point;
-        FeatureInformation(const Vector3d &_point): point(_point)
+        Vector3d point_right;   // right camera measurement, only valid if is_stereo
+        bool is_stereo;
+        FeatureInformation(): point(Vector3d::Zero()), point_right(Vector3d::Zero()), is_stereo(false)
+        {}
+        FeatureInformation(const Vector3d &_point): point(_point), point_right(Vector3d::Zero()), is_stereo(false)
+        {}
+        FeatureInformation(const Vector3d &_point, const Vector3d &_point_right):
+        point(_point), point_right(_point_right), is_stereo(true)
         {}
 };
 
@@ -46,8 +53,8 @@ class FeatureRecord
         }
     
     
-        FeatureRecord(int _start_frame, const Vector3d &_feature_point):
-        feature_points {FeatureInformation(_feature_point)}
+        FeatureRecord(int _start_frame, const FeatureInformation &_feature_point):
+        feature_points {_feature_point}
         {
             start_frame = _start_frame;
             is_used = false;
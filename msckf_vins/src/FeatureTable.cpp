@@ -0,0 +1,252 @@
+//
+//  FeatureTable.cpp
+//  msckf_vins
+//
+
+#include "FeatureTable.h"
+#include <cmath>
+#include <algorithm>
+using namespace std;
+
+const int SlotHash::EMPTY_KEY;
+static const int INITIAL_CAPACITY = 256;
+
+SlotHash::SlotHash()
+{
+    clear();
+}
+
+void SlotHash::rehash(int capacity)
+{
+    vector<int> old_keys(capacity, EMPTY_KEY);
+    vector<int> old_slots(capacity, -1);
+    keys.swap(old_keys);
+    slots.swap(old_slots);
+    mask = (unsigned int)capacity - 1;
+
+    for (int i = 0; i < (int)old_keys.size(); i++)
+    {
+        if (old_keys[i] == EMPTY_KEY)
+        {
+            continue;
+        }
+        unsigned int b = bucket(old_keys[i]);
+        while (keys[b] != EMPTY_KEY)
+        {
+            b = (b + 1) & mask;
+        }
+        keys[b] = old_keys[i];
+        slots[b] = old_slots[i];
+    }
+}
+
+void SlotHash::insert(int id, int slot)
+{
+    // keep the load factor below 1/2 so probe chains stay short
+    if (2 * (count + 1) > (int)keys.size())
+    {
+        rehash(2 * (int)keys.size());
+    }
+
+    unsigned int b = bucket(id);
+    while (keys[b] != EMPTY_KEY)
+    {
+        b = (b + 1) & mask;
+    }
+    keys[b] = id;
+    slots[b] = slot;
+    count++;
+}
+
+// backward shift deletion, keeps every probe chain without holes
+void SlotHash::erase(int id)
+{
+    unsigned int hole = locate(id);
+    unsigned int next = (hole + 1) & mask;
+    while (keys[next] != EMPTY_KEY)
+    {
+        // an entry may move back into the hole only if its home bucket is not in (hole, next]
+        unsigned int home = bucket(keys[next]);
+        if (((next - home) & mask) >= ((next - hole) & mask))
+        {
+            keys[hole] = keys[next];
+            slots[hole] = slots[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+    keys[hole] = EMPTY_KEY;
+    slots[hole] = -1;
+    count--;
+}
+
+void SlotHash::clear()
+{
+    keys.assign(INITIAL_CAPACITY, EMPTY_KEY);
+    slots.assign(INITIAL_CAPACITY, -1);
+    mask = (unsigned int)INITIAL_CAPACITY - 1;
+    count = 0;
+}
+
+FeatureTable::FeatureTable()
+{
+    fill(clone_obs_count, clone_obs_count + SLIDING_WINDOW_SIZE, 0);
+}
+
+int FeatureTable::insert(int id, int _start_frame, int clone_slot, const FeatureInformation &feature_point)
+{
+    int slot = size();
+    ids.push_back(id);
+    start_frame.push_back(_start_frame);
+    is_used.push_back(false);
+    is_lost.push_back(false);
+    is_outlier.push_back(false);
+    tracks.emplace_back();
+
+    slot_of.insert(id, slot);
+
+    addObservation(slot, clone_slot, feature_point);
+    return slot;
+}
+
+void FeatureTable::addObservation(int slot, int clone_slot, const FeatureInformation &feature_point)
+{
+    FeatureTrack &track = tracks[slot];
+    CloneColumn &column = columns[clone_slot];
+    if (track.has(clone_slot))
+    {
+        // overwrite in place
+        column.u[track.col[clone_slot]] = feature_point.point(0);
+        column.v[track.col[clone_slot]] = feature_point.point(1);
+        track.add(clone_slot, feature_point);
+        return;
+    }
+
+    if (!is_used[slot])
+    {
+        clone_obs_count[clone_slot]++;
+    }
+    track.col[clone_slot] = column.size();
+    column.slot.push_back(slot);
+    column.u.push_back(feature_point.point(0));
+    column.v.push_back(feature_point.point(1));
+    track.add(clone_slot, feature_point);
+}
+
+void FeatureTable::eraseObservation(int slot, int clone_slot)
+{
+    FeatureTrack &track = tracks[slot];
+    if (!track.has(clone_slot))
+    {
+        return;
+    }
+    if (!is_used[slot])
+    {
+        clone_obs_count[clone_slot]--;
+    }
+
+    // the last entry of the column fills the hole
+    CloneColumn &column = columns[clone_slot];
+    int hole = track.col[clone_slot];
+    int last = column.size() - 1;
+    if (hole != last)
+    {
+        column.slot[hole] = column.slot[last];
+        column.u[hole] = column.u[last];
+        column.v[hole] = column.v[last];
+        tracks[column.slot[hole]].col[clone_slot] = hole;
+    }
+    column.slot.pop_back();
+    column.u.pop_back();
+    column.v.pop_back();
+    track.erase(clone_slot);
+}
+
+double FeatureTable::cloneParallax(int clone_a, int clone_b) const
+{
+    const CloneColumn &column = columns[clone_a];
+    double sum = 0.0;
+    int num = 0;
+    for (int i = 0; i < column.size(); i++)
+    {
+        const FeatureTrack &track = tracks[column.slot[i]];
+        if (track.has(clone_b))
+        {
+            const FeatureInformation &obs = track.obs[clone_b];
+            sum += hypot(column.u[i] - obs.point(0), column.v[i] - obs.point(1));
+            num++;
+        }
+    }
+    return num > 0 ? sum / num : 0.0;
+}
+
+void FeatureTable::markUsed(int slot)
+{
+    if (is_used[slot])
+    {
+        return;
+    }
+    is_used[slot] = true;
+    for (int c = 0; c < SLIDING_WINDOW_SIZE; c++)
+    {
+        if (tracks[slot].has(c))
+        {
+            clone_obs_count[c]--;
+        }
+    }
+}
+
+void FeatureTable::remove(int slot)
+{
+    for (int c = 0; c < SLIDING_WINDOW_SIZE; c++)
+    {
+        eraseObservation(slot, c);
+    }
+    slot_of.erase(ids[slot]);
+
+    int last = size() - 1;
+    if (slot != last)
+    {
+        ids[slot] = ids[last];
+        start_frame[slot] = start_frame[last];
+        is_used[slot] = is_used[last];
+        is_lost[slot] = is_lost[last];
+        is_outlier[slot] = is_outlier[last];
+        tracks[slot] = tracks[last];
+
+        // re-point the column entries of the moved feature
+        for (int c = 0; c < SLIDING_WINDOW_SIZE; c++)
+        {
+            if (tracks[slot].has(c))
+            {
+                columns[c].slot[tracks[slot].col[c]] = slot;
+            }
+        }
+
+        // point the moved id at its new slot
+        slot_of.assign(ids[slot], slot);
+    }
+
+    ids.pop_back();
+    start_frame.pop_back();
+    is_used.pop_back();
+    is_lost.pop_back();
+    is_outlier.pop_back();
+    tracks.pop_back();
+}
+
+void FeatureTable::clear()
+{
+    ids.clear();
+    start_frame.clear();
+    is_used.clear();
+    is_lost.clear();
+    is_outlier.clear();
+    tracks.clear();
+    slot_of.clear();
+    fill(clone_obs_count, clone_obs_count + SLIDING_WINDOW_SIZE, 0);
+    for (int c = 0; c < SLIDING_WINDOW_SIZE; c++)
+    {
+        columns[c].clear();
+    }
+}
@@ -0,0 +1,210 @@
+//
+//  FeatureTable.h
+//  msckf_vins
+//
+//  feature store of the filter. Tracker ids are remapped to dense slots
+//  0..size()-1 through an open addressing hash (linear probing), the per
+//  feature data lives in parallel arrays indexed by slot, so the per frame
+//  passes in processImage are linear scans. Removing a feature moves the
+//  last slot into the hole, slot numbers are only stable until the next
+//  remove.
+//
+//  The observations of a feature are kept inline in a FeatureTrack, one
+//  entry per clone slot of the sliding window, so adding an observation or
+//  dropping a clone never allocates or shifts elements.
+//
+//  Next to this feature major view every clone slot has a CloneColumn, the
+//  (feature slot, u, v) of all observations made in that frame stored
+//  contiguously, for passes that go frame by frame. A track remembers where
+//  its observations sit in the columns, so both views are updated in O(1)
+//  per observation.
+//
+
+#ifndef __msckf_vins__FeatureTable__
+#define __msckf_vins__FeatureTable__
+
+#include <vector>
+#include <algorithm>
+#include "g_param.h"
+#include "FeatureRecord.h"
+
+static_assert(SLIDING_WINDOW_SIZE <= 32, "clone slots are tracked in a 32 bit mask");
+
+// observations of one feature, indexed by the clone slot of the frame they were made in
+class FeatureTrack
+{
+public:
+    FeatureInformation obs[SLIDING_WINDOW_SIZE];
+    int col[SLIDING_WINDOW_SIZE];   // index of obs[i] in the column of clone slot i
+    unsigned int clone_mask;        // bit i set if obs[i] is valid
+
+    FeatureTrack(): clone_mask(0)
+    {
+        std::fill(col, col + SLIDING_WINDOW_SIZE, -1);
+    }
+
+    int size() const
+    {
+        return __builtin_popcount(clone_mask);
+    }
+
+    bool has(int clone_slot) const
+    {
+        return (clone_mask >> clone_slot) & 1u;
+    }
+
+    void add(int clone_slot, const FeatureInformation &feature_point)
+    {
+        obs[clone_slot] = feature_point;
+        clone_mask |= 1u << clone_slot;
+    }
+
+    void erase(int clone_slot)
+    {
+        clone_mask &= ~(1u << clone_slot);
+    }
+};
+
+// observations made in one clone, structure of arrays
+class CloneColumn
+{
+public:
+    std::vector<int> slot;      // feature slot in the table
+    std::vector<double> u;
+    std::vector<double> v;
+
+    int size() const
+    {
+        return (int)slot.size();
+    }
+
+    void clear()
+    {
+        slot.clear();
+        u.clear();
+        v.clear();
+    }
+};
+
+// open addressing hash (linear probing) from a non negative id to a slot,
+// power of two capacity
+class SlotHash
+{
+    std::vector<int> keys;
+    std::vector<int> slots;
+    unsigned int mask;
+    int count;
+
+    unsigned int bucket(int id) const
+    {
+        // multiplicative hash, spreads sequential tracker ids
+        return ((unsigned int)id * 2654435769u) & mask;
+    }
+    // bucket holding id, id must be in the hash
+    unsigned int locate(int id) const
+    {
+        unsigned int b = bucket(id);
+        while (keys[b] != id)
+        {
+            b = (b + 1) & mask;
+        }
+        return b;
+    }
+    void rehash(int capacity);
+
+public:
+    // -1 marks a free bucket
+    static const int EMPTY_KEY = -1;
+
+    SlotHash();
+
+    int size() const
+    {
+        return count;
+    }
+
+    // slot of id, -1 if unknown
+    int find(int id) const
+    {
+        unsigned int b = bucket(id);
+        while (keys[b] != EMPTY_KEY)
+        {
+            if (keys[b] == id)
+            {
+                return slots[b];
+            }
+            b = (b + 1) & mask;
+        }
+        return -1;
+    }
+
+    // id must not be in the hash yet
+    void insert(int id, int slot);
+    // id must be in the hash
+    void assign(int id, int slot)
+    {
+        slots[locate(id)] = slot;
+    }
+    void erase(int id);
+    void clear();
+};
+
+class FeatureTable
+{
+    // tracker id to slot
+    SlotHash slot_of;
+
+public:
+    /* per slot data */
+    std::vector<int> ids;
+    std::vector<int> start_frame;
+    std::vector<unsigned char> is_used;
+    std::vector<unsigned char> is_lost;
+    std::vector<unsigned char> is_outlier;
+    std::vector<FeatureTrack> tracks;
+
+    // per clone slot: observations of features that are not used yet,
+    // a clone whose count is 0 carries no pending measurement
+    int clone_obs_count[SLIDING_WINDOW_SIZE];
+
+    // frame major view, indexed by clone slot
+    CloneColumn columns[SLIDING_WINDOW_SIZE];
+
+    FeatureTable();
+
+    int size() const
+    {
+        return (int)ids.size();
+    }
+
+    // slot of id, -1 if unknown
+    int find(int id) const
+    {
+        return slot_of.find(id);
+    }
+
+    // append a new feature observed first in clone_slot, id must not be in the table yet, returns its slot
+    int insert(int id, int _start_frame, int clone_slot, const FeatureInformation &feature_point);
+    // append an observation in clone_slot to an existing feature
+    void addObservation(int slot, int clone_slot, const FeatureInformation &feature_point);
+    void eraseObservation(int slot, int clone_slot);
+
+    // the feature has been consumed (or dropped), its observations no longer hold their clones
+    void markUsed(int slot);
+
+    // a new clone takes clone_slot
+    void resetClone(int clone_slot)
+    {
+        clone_obs_count[clone_slot] = 0;
+        columns[clone_slot].clear();
+    }
+
+    // mean pixel displacement of the features seen in both clones, 0 if there is none
+    double cloneParallax(int clone_a, int clone_b) const;
+
+    // drop a slot, the last slot takes its place
+    void remove(int slot);
+    void clear();
+};
+
+#endif /* defined(__msckf_vins__FeatureTable__) */
@@ -9,6 +9,7 @@
 #include "MSCKF.h"
 #include "math_tool.h"
 #include "g_param.h"
+#include "tic_toc.h"
 #include <ros/ros.h>
 
 using namespace ros;
@@ -24,19 +25,44 @@ MSCKF::MSCKF()
     
     Nc = MatrixXd::Zero(ERROR_STATE_SIZE, ERROR_STATE_SIZE);
     setNoiseMatrix(0.1f, 0.1f, 0.1f, 0.1f);
+    measure_noise = 1.0;
     
     current_time = -1.0f;
     
+    // intrinsics and distortion are set by setCalibParam
     cam.setImageSize(480, 752);
     
-    cam.setIntrinsicMtx(365.07984, 365.12127, 381.0196, 254.4431);
-    cam.setDistortionParam(-2.842958e-1,
-                           8.7155025e-2,
-                           -1.4602925e-4,
-                           -6.149638e-4,
-                           -1.218237e-2);
-    
     current_frame = -1;   // initially no frame
+    window_size = SLIDING_WINDOW_SIZE;
+    window_deadline = 0.0;
+    process_time = -1.0;
+    clone_slot_mask = 0;
+    
+    max_update_rows = 0;
+    update_time_budget = 0.0;
+    update_row_cap = 0;
+    selection_score = SCORE_TRACE_REDUCTION;
+    
+    setGatingConfidence(0.95);
+    num_gated = 0;
+    num_rejected = 0;
+    
+    max_landmarks = 0;
+    
+    keyframe_rotation = 0.0;
+    keyframe_translation = 0.0;
+    keyframe_parallax = 0.0;
+    
+    zupt_imu_window = 0;
+    zupt_acc_std = 0.0;
+    zupt_gyro_std = 0.0;
+    zupt_pixel_motion = 0.0;
+    is_stationary = false;
+    
+    use_stereo = false;
+    cam_right.setImageSize(480, 752);
+    R_rl = Matrix3d::Identity();
+    t_rl = Vector3d::Zero();
     
 //    R_cb = Matrix3d::Identity();
     R_cb <<
@@ -78,11 +104,90 @@ void MSCKF::setNominalState(Vector4d q, Vector3d p, Vector3d v, Vector3d bg, Vec
     fullNominalState.segment(13, 3) = ba;
 }
 
-void MSCKF::setCalibParam(Vector3d p_cb, double fx, double fy, double ox, double oy, double k1, double k2, double p1, double p2, double k3)
+bool MSCKF::setCalibParam(Vector3d p_cb, double fx, double fy, double ox, double oy, const vector<double> &dist)
 {
     fullNominalState.segment(16, 3) = p_cb;
     cam.setIntrinsicMtx(fx, fy, ox, oy);
-    cam.setDistortionParam(k1, k2, p1, p2, k3);
+    return cam.setDistortionParam(dist);
+}
+
+bool MSCKF::setStereoCalibParam(double fx, double fy, double ox, double oy, const vector<double> &dist,
+                                Matrix3d _R_rl, Vector3d _t_rl)
+{
+    cam_right.setIntrinsicMtx(fx, fy, ox, oy);
+    R_rl = _R_rl;
+    t_rl = _t_rl;
+    use_stereo = cam_right.setDistortionParam(dist);
+    return use_stereo;
+}
+
+void MSCKF::setWindowSize(int _window_size)
+{
+    // a monocular track needs 3 frames, stereo tracks can do with a smaller window
+    window_size = max(use_stereo ? 2 : 4, min(_window_size, SLIDING_WINDOW_SIZE));
+}
+
+void MSCKF::setWindowDeadline(double deadline)
+{
+    window_deadline = max(0.0, deadline);
+    process_time = -1.0;
+}
+
+void MSCKF::setUpdateBudget(int max_rows, double max_time_ms, int score)
+{
+    max_update_rows = max(0, max_rows);
+    update_time_budget = max(0.0, max_time_ms);
+    // the time budget only steers the cap once an update has been timed
+    update_row_cap = max_update_rows > 0 ? max_update_rows : INITIAL_UPDATE_ROWS;
+    selection_score = score;
+}
+
+void MSCKF::setGatingConfidence(double confidence)
+{
+    gating_confidence = confidence;
+    // a feature gives at most 2 * 2 * SLIDING_WINDOW_SIZE - 3 rows (stereo)
+    chi_square_table.resize(4 * SLIDING_WINDOW_SIZE);
+    chi_square_table[0] = 0.0;
+    for (int dof = 1; dof < (int)chi_square_table.size(); dof++)
+    {
+        chi_square_table[dof] = chi_square_inv(confidence, dof);
+    }
+}
+
+void MSCKF::setLandmarkBudget(int _max_landmarks)
+{
+    max_landmarks = max(0, min(_max_landmarks, MAX_SLAM_LANDMARKS));
+}
+
+void MSCKF::setKeyframePolicy(double rotation, double translation, double parallax)
+{
+    keyframe_rotation = max(0.0, rotation);
+    keyframe_translation = max(0.0, translation);
+    keyframe_parallax = max(0.0, parallax);
+}
+
+void MSCKF::setZuptConfig(int imu_window, double acc_std, double gyro_std, double pixel_motion)
+{
+    zupt_imu_window = max(0, imu_window);
+    zupt_acc_std = acc_std;
+    zupt_gyro_std = gyro_std;
+    zupt_pixel_motion = pixel_motion;
+    zupt_acc.clear();
+    zupt_gyro.clear();
+}
+
+void MSCKF::initUndistortMap(int step, const string &cache_path)
+{
+    if (step <= 0)
+    {
+        ROS_WARN("undistort map step %d is not positive, undistorting iteratively", step);
+        return;
+    }
+    if (undistort_map.init(cam, step, cache_path))
+        ROS_INFO("undistort map loaded from %s", cache_path.c_str());
+    else
+        ROS_INFO("undistort map built with step %d", step);
+    cam.setUndistortMap(&undistort_map);
 }
 
 void MSCKF::setIMUCameraRotation(Matrix3d _R_cb)
@@ -122,6 +227,13 @@ void MSCKF::correctNominalState(VectorXd delta)
         
         itr++;
     }
+    
+    // landmarks follow the clones in the error state
+    int landmark_index = landmarkIndex();
+    for (int j = 0; j < (int)landmark_pos.size(); j++)
+    {
+        landmark_pos[j] += delta.segment(landmark_index + 3*j, 3);
+    }
 }
 
 void MSCKF::processIMU(double t, Vector3d linear_acceleration, Vector3d angular_velocity)
@@ -146,6 +258,18 @@ void MSCKF::processIMU(double t, Vector3d linear_acceleration, Vector3d angular_
   
     spatial_rotation = spa;
     //spatial_rotation = quaternion_to_R(spatial_quaternion); //R_gb
+    
+    // raw samples for the stationarity test
+    if (zupt_imu_window > 0)
+    {
+        zupt_acc.push_back(linear_acceleration);
+        zupt_gyro.push_back(angular_velocity);
+        if ((int)zupt_acc.size() > zupt_imu_window)
+        {
+            zupt_acc.pop_front();
+            zupt_gyro.pop_front();
+        }
+    }
     if (current_time < 0.0f)
     {
         current_time = t;
@@ -242,44 +366,81 @@ void MSCKF::processIMU(double t, Vector3d linear_acceleration, Vector3d angular_
     //std::cout << "phi is" << std::endl;
     //std::cout << phi << std::endl;
     
+    // the imu block and its correlation with p_cb, the clones and the landmarks
+    int n = (int)fullErrorCovariance.rows() - ERROR_STATE_SIZE;
+    errorCovariance = fullErrorCovariance.block<ERROR_STATE_SIZE, ERROR_STATE_SIZE>(0, 0);
     errorCovariance = phi * (errorCovariance + 0.5 * dt * Nc) * phi.transpose() + Nc;
-    
+    errorCovariance = 0.5 * (errorCovariance + errorCovariance.transpose());
     fullErrorCovariance.block<ERROR_STATE_SIZE, ERROR_STATE_SIZE>(0, 0) = errorCovariance;
+    fullErrorCovariance.block(0, ERROR_STATE_SIZE, ERROR_STATE_SIZE, n) =
+        phi * fullErrorCovariance.block(0, ERROR_STATE_SIZE, ERROR_STATE_SIZE, n);
+    fullErrorCovariance.block(ERROR_STATE_SIZE, 0, n, ERROR_STATE_SIZE) =
+        fullErrorCovariance.block(0, ERROR_STATE_SIZE, ERROR_STATE_SIZE, n).transpose();
     
     return;
 }
 
 void MSCKF::processImage(const vector<pair<int, Vector3d>> &image)
 {
+    processImage(image, vector<pair<int, Vector3d>>());
+}
+
+void MSCKF::processImage(const vector<pair<int, Vector3d>> &image, const vector<pair<int, Vector3d>> &image_right)
+{
+    TicToc t_process;
     printNominalState(false);
-    printf("input feature: %lu\n", image.size());
+    ROS_DEBUG("input feature: %lu", image.size());
+    num_gated = 0;
+    num_rejected = 0;
+    
+    // standing still: no clone, no triangulation, the tracks simply go on in the next moving image
+    bool was_stationary = is_stationary;
+    is_stationary = detectStationary(image);
+    if (is_stationary != was_stationary)
+    {
+        ROS_INFO("%s", is_stationary ? "stationary, zero velocity updates" : "moving, vision updates");
+    }
+    if (is_stationary)
+    {
+        zeroVelocityUpdate();
+        return;
+    }
     
     // init is_lost
-    for (auto & item : feature_record_dict)
+    for (int k = 0; k < feature_table.size(); k++)
     {
-        if (item.second.is_used == false)
+        if (feature_table.is_used[k] == false)
         {
-            item.second.is_lost = true;
+            feature_table.is_lost[k] = true;
         }
     }
     
     // add sliding state
     // removeSlideState if the window is full already
-    if (current_frame == SLIDING_WINDOW_SIZE-1)
+    while (current_frame >= window_size-1)
     {
-        removeSlideState(1, SLIDING_WINDOW_SIZE);
-        removeFrameFeatures(1);
-        current_frame--;
+        marginalizeClone(leastInformativeClone());
     }
     
     addSlideState();
     ++current_frame;
-    printf("current frame is %d\n", current_frame);
-    addFeatures(image);     // is_lost modified here
+    ROS_DEBUG("current frame is %d", current_frame);
+    if (landmark_ids.empty())
+    {
+        addFeatures(image, image_right);     // is_lost modified here
+    }
+    else
+    {
+        // landmark observations are used right away, the rest goes to the feature table
+        vector<pair<int, Vector3d>> image_feature, image_right_feature;
+        updateLandmarks(image, image_right, image_feature, image_right_feature);
+        addFeatures(image_feature, image_right_feature);     // is_lost modified here
+    }
 
 
     //check is_lost to get measurement
-    MatrixXd measure_mtx;
+    MatrixXd measure_mtx, measure_right;
+    vector<bool> stereo_mask;
     MatrixXd pose_mtx;
     Vector3d ptr_pose;
     
@@ -290,59 +451,32 @@ void MSCKF::processImage(const vector<pair<int, Vector3d>> &image)
     
     int num_measure = 0;
     int row_H = 0;
-    for (auto & item : feature_record_dict)
+    vector<MeasurementCandidate> candidates;
+    for (int k = 0; k < feature_table.size(); k++)
     {
-        if (item.second.is_lost == true)
+        if (feature_table.is_lost[k] == true)
         {
-            if (current_frame - item.second.start_frame >= 3)
+            int start_frame = feature_table.start_frame[k];
+            const FeatureTrack &track = feature_table.tracks[k];
+            int num_frame = current_frame - start_frame;
+            int num_stereo = 0;
+            if (use_stereo)
+            {
+                for (int c = 0; c < SLIDING_WINDOW_SIZE; c++)
+                    num_stereo += track.has(c) && track.obs[c].is_stereo;
+            }
+            
+            // a stereo observation gives depth instantly, monocular tracks need 3 frames
+            if (num_frame >= 3 || num_stereo > 0)
             {
                 /* 1. prepare to do triangulation */
-                std::vector<FeatureInformation>::iterator itr_f = item.second.feature_points.begin();
-                std::list<SlideState>::iterator           itr_s = slidingWindow.begin();
-                for (int i = 0; i < item.second.start_frame; i++)
-                {
-                    itr_s ++;
-                }
-                
-                int num_frame = current_frame - item.second.start_frame;
-                
-                measure_mtx = MatrixXd::Zero(2, num_frame);
-                pose_mtx = MatrixXd::Zero(7, num_frame);
-                
-                for (int i = item.second.start_frame; i < current_frame; i++)
-                {
-                    // construct measure
-                    measure_mtx(0, i-item.second.start_frame) = itr_f->point.x();
-                    measure_mtx(1, i-item.second.start_frame) = itr_f->point.y();
+                buildMeasurement(k, num_frame, measure_mtx, pose_mtx, measure_right, stereo_mask);
                 
-                    // construct pose
-                    Matrix3d R_gb, R_gc;
-                    Vector3d p_gb, p_gc;
-                    R_gb = quaternion_to_R(itr_s->q);
-                    p_gb = itr_s->p;
-                    
-                    R_gc = R_gb*R_cb.transpose();
-                    
-                    /* p_gc = p_gb + p_bc */
-                    /* p_bc = -R_cb^T * p_cb */
-                    p_gc = p_gb + -R_cb.transpose() * fullNominalState.segment(16, 3);
-                    
-                    pose_mtx.block<4,1>(0, i-item.second.start_frame) = R_to_quaternion(R_gc);  // q_gc
-                    pose_mtx.block<3,1>(4, i-item.second.start_frame) = p_gc;                   // p_gc
-//                    pose_mtx.block<4,1>(0, i-item.second.start_frame) = itr_s->q;  // q_gb
-//                    pose_mtx.block<3,1>(4, i-item.second.start_frame) = itr_s->p;  // p_gb
-                    
-                    //Quaterniond q;
-                    //q = Matrix3d::Identity()*R_cb.transpose();
-                    //cout << R_to_quaternion(R_gc).transpose() << endl;
-                    //cout << q.w() << " " << q.x() << " " << q.y() << " " << q.z() << " "  <<endl;
-                    
-                    itr_f++;
-                    itr_s++;
-                }
-                
-                ptr_pose = cam.triangulate(measure_mtx, pose_mtx);
-                ROS_INFO("I triangulated a point with id %d (%lf, %lf, %lf)", item.first, ptr_pose(0), ptr_pose(1), ptr_pose(2));
+                if (num_stereo > 0)
+                    ptr_pose = triangulateStereo(measure_mtx, pose_mtx, measure_right, stereo_mask);
+                else
+                    ptr_pose = cam.triangulate(measure_mtx, pose_mtx);
+                ROS_INFO("I triangulated a point with id %d (%lf, %lf, %lf)", feature_table.ids[k], ptr_pose(0), ptr_pose(1), ptr_pose(2));
                 // check ptr_pose validity (it cannot be strange value)
                 bool is_valid = true;
                 // TODO: can add more validity check (for example, the ptr_pose should be in front of the camera)
@@ -359,34 +493,62 @@ void MSCKF::processImage(const vector<pair<int, Vector3d>> &image)
                 /* 2. calculate r and H */
                 if (is_valid)
                 {
-                    // construct H matrix use ptr_pose, item.second.start_frame and current_frame
+                    // construct H matrix use ptr_pose, start_frame and current_frame
                     VectorXd ri;
                     MatrixXd Hi;
-                    if (getResidualH(ri, Hi, ptr_pose, measure_mtx, pose_mtx, item.second.start_frame) == true)
+                    if (getResidualH(ri, Hi, ptr_pose, measure_mtx, pose_mtx, start_frame,
+                                     measure_right, stereo_mask) == true)
                     {
-                      num_measure++;
-                      row_H += (2 * num_frame - 3); // after feature error marginalization
-                      
-                      // TODO: outlier reject: Chi-square test
+                      // after feature error marginalization: 2 * (num_frame + num_stereo) - 3 rows
                       
-                      residual_list.push_back(ri);
-                      H_mtx_list.push_back(Hi);
-                      H_mtx_block_size_list.push_back(2 * num_frame - 3);
+                      // outlier reject: chi-square test, a rejected feature never reaches the stacked update
+                      LLT<MatrixXd> S_llt;
+                      num_gated++;
+                      if (gatingTest(ri, Hi, start_frame, (int)pose_mtx.cols(), S_llt))
+                      {
+                          MeasurementCandidate candidate;
+                          candidate.r = ri;
+                          candidate.H = Hi;
+                          candidate.score = scoreMeasurement(ri, Hi, start_frame, (int)pose_mtx.cols(), measure_mtx, S_llt);
+                          candidates.push_back(candidate);
+                      }
+                      else
+                      {
+                          num_rejected++;
+                          feature_table.is_outlier[k] = true;
+                      }
                     }
-                    item.second.is_used = true;
-                    item.second.is_lost = false;
+                    feature_table.markUsed(k);
+                    feature_table.is_lost[k] = false;
                     
                 }
             }
             else
             {
                 // not enough number of frame, does not generate measure
-                item.second.is_used = true;
-                item.second.is_lost = false;
+                feature_table.markUsed(k);
+                feature_table.is_lost[k] = false;
             }
         }
     }
     
+    if (num_rejected > 0)
+    {
+        ROS_INFO("chi-square gating rejected %d of %d features", num_rejected, num_gated);
+    }
+    
+    // keep the most informative measurements within the update budget
+    selectMeasurements(candidates);
+    for (auto & candidate : candidates)
+    {
+        num_measure++;
+        row_H += (int)candidate.r.size();
+        residual_list.push_back(candidate.r);
+        H_mtx_list.push_back(candidate.H);
+        H_mtx_block_size_list.push_back((int)candidate.r.size());
+    }
+    
+    TicToc t_update;
     if (num_measure == 0) // this may due to hovering
     {
         
@@ -419,80 +581,37 @@ void MSCKF::processImage(const vector<pair<int, Vector3d>> &image)
             itr_H_size++;
         }
 
-        VectorXd delta_x;
-        // when there are a lot of features, use QR of H to speed up computation
-        //if (H.rows()>H.cols())
-        if (0)
-        {
-            HouseholderQR<MatrixXd> qr(H.cast<double>());
-            MatrixXd R = qr.matrixQR().triangularView<Upper>();
-            MatrixXd Q = qr.householderQ();
-            MatrixXd Th = R.topRows(col_H).cast<double>();
-            MatrixXd Q1 = Q.leftCols(col_H).cast<double>();
-            
-            /* 3. calculate Kalman gain */
-            MatrixXd Rq = MatrixXd::Identity(row_H, row_H) * measure_noise*measure_noise;
-            MatrixXd tmpK = (Th * fullErrorCovariance * Th.transpose() + Rq).inverse();
-            MatrixXd K = fullErrorCovariance * Th.transpose() * tmpK;
-        
-            /* 4. update error covariance */
-            MatrixXd ImKH = MatrixXd::Identity(col_H, col_H) - K * Th;
-            fullErrorCovariance = ImKH * fullErrorCovariance * ImKH.transpose() + K * Rq * K.transpose();
-        
-            delta_x = K * Q1.transpose() * r;
-        }
-        else
+        measurementUpdate(H, r);
+
+        // steer the row cap towards the time budget, the update is roughly cubic in the rows
+        if (update_time_budget > 0)
         {
-            MatrixXd Rq = MatrixXd::Identity(row_H, row_H) * measure_noise*measure_noise;
-            //ROS_INFO("H matrix");
-            //cout << H << endl;
-            MatrixXd tmpK = (H * fullErrorCovariance * H.transpose() + Rq).inverse();
-            MatrixXd K = fullErrorCovariance * H.transpose() * tmpK;
-            //ROS_INFO("K matrix");
-            //cout << K << endl;
-            MatrixXd ImKH = MatrixXd::Identity(col_H, col_H) - K * H;
-            fullErrorCovariance = ImKH * fullErrorCovariance*ImKH.transpose() + K * Rq * K.transpose();
-            //ROS_INFO("r");
-            //cout << r.transpose() << endl;
-            delta_x = K * r;
+            double t = max(t_update.toc(), 1e-3);
+            int cap = (int)(row_H * cbrt(update_time_budget / t));
+            update_row_cap = max(cap, ERROR_STATE_SIZE);
+            if (max_update_rows > 0)
+                update_row_cap = min(update_row_cap, max_update_rows);
         }
-        
-        
-        ROS_INFO("A correction calculated");
-        cout << delta_x << endl;;
-        correctNominalState(delta_x);
-
     }
     
     
-    // remove all is_used == true sliding state
-    int feature_count;
-    int used_count;
+    // move the longest live tracks into the state before the window cuts them
+    if (max_landmarks > 0)
+    {
+        promoteLandmarks();
+    }
+    
+    // remove the sliding states all of whose observations are used,
+    // the feature table keeps a live count per clone so no feature is scanned
     list<int> frame_to_remove;
     frame_to_remove.clear();
-    for (int i = 0; i < current_frame; i++)
+    std::list<SlideState>::iterator itr_s = slidingWindow.begin();
+    for (int i = 0; i < current_frame; i++, itr_s++)
     {
-        feature_count = 0;
-        used_count = 0;
-        for (auto & item : feature_record_dict)
-        {
-            if (item.second.start_frame <= i)
-            {
-                feature_count++;
-            }
-            if (item.second.is_used == true)
-            {
-                used_count++;
-            }
-        }
-        if (feature_count == used_count) // all features under this state are used
+        if (feature_table.clone_obs_count[itr_s->slot] == 0)
         {
-            if (feature_count > 0)
-            {
-                frame_to_remove.push_back(i);
-            }
+            frame_to_remove.push_back(i);
         }
-        
     }
     
 //    cout << __FILE__ << ":" << __LINE__ <<endl;
@@ -504,20 +623,95 @@ void MSCKF::processImage(const vector<pair<int, Vector3d>> &image)
         //cout << frame << endl;
         //printNominalState(true);
         
-        removeSlideState(frame - offset, current_frame + 1);
         removeFrameFeatures(frame - offset);
+        removeSlideState(frame - offset, current_frame + 1);
         current_frame--;
         
         //printNominalState(true);
         offset++;
     }
     
+    // the clone before the newest one is not a keyframe if the newest one is still close
+    // to the keyframe before it, the newest clone takes its place
+    if (current_frame >= 2)
+    {
+        std::list<SlideState>::iterator itr_newest = std::prev(slidingWindow.end());
+        std::list<SlideState>::iterator itr_keyframe = std::prev(itr_newest, 2);
+        if (cloneMotion(*itr_keyframe, *itr_newest) < 1.0)
+        {
+            marginalizeClone(current_frame - 1);
+        }
+    }
+    
+    adaptWindowSize(t_process.toc());
+    
 //    cout << __FILE__ << ":" << __LINE__ <<endl;
 //    printNominalState(true);
     
     return;
 }
 
+// camera pose of a clone in the form pose_mtx carries it: q_gc, p_gc
+void MSCKF::getCameraPose(const SlideState &state, Vector4d &q_gc, Vector3d &p_gc)
+{
+    Matrix3d R_gb, R_gc;
+    Vector3d p_gb;
+    R_gb = quaternion_to_R(state.q);
+    p_gb = state.p;
+    
+    R_gc = R_gb*R_cb.transpose();
+    
+    /* p_gc = p_gb + R_gb * p_bc */
+    /* p_bc = -R_cb^T * p_cb */
+    p_gc = p_gb - R_gc * fullNominalState.segment(16, 3);
+    q_gc = R_to_quaternion(R_gc);
+}
+
+// measurements and camera poses of feature slot k over num_frame clones from its start frame
+void MSCKF::buildMeasurement(int k, int num_frame, MatrixXd &measure_mtx, MatrixXd &pose_mtx,
+                             MatrixXd &measure_right, vector<bool> &stereo_mask)
+{
+    int start_frame = feature_table.start_frame[k];
+    const FeatureTrack &track = feature_table.tracks[k];
+    std::list<SlideState>::iterator itr_s = slidingWindow.begin();
+    for (int i = 0; i < start_frame; i++)
+    {
+        itr_s ++;
+    }
+    
+    measure_mtx = MatrixXd::Zero(2, num_frame);
+    measure_right = MatrixXd::Zero(2, num_frame);
+    stereo_mask.assign(num_frame, false);
+    pose_mtx = MatrixXd::Zero(7, num_frame);
+    
+    for (int j = 0; j < num_frame; j++)
+    {
+        // the track is continuous, every clone from start_frame on has an observation
+        const FeatureInformation *itr_f = &track.obs[itr_s->slot];
+        
+        // construct measure
+        measure_mtx(0, j) = itr_f->point.x();
+        measure_mtx(1, j) = itr_f->point.y();
+        if (use_stereo && itr_f->is_stereo)
+        {
+            measure_right(0, j) = itr_f->point_right.x();
+            measure_right(1, j) = itr_f->point_right.y();
+            stereo_mask[j] = true;
+        }
+        
+        // construct pose
+        Vector4d q_gc;
+        Vector3d p_gc;
+        getCameraPose(*itr_s, q_gc, p_gc);
+        pose_mtx.block<4,1>(0, j) = q_gc;
+        pose_mtx.block<3,1>(4, j) = p_gc;
+//        pose_mtx.block<4,1>(0, j) = itr_s->q;  // q_gb
+//        pose_mtx.block<3,1>(4, j) = itr_s->p;  // p_gb
+        
+        itr_s++;
+    }
+}
+
 void MSCKF::addSlideState()
 {
     SlideState newState;
@@ -535,24 +729,40 @@ void MSCKF::addSlideState()
     newState.q = fullNominalState.head(4);
     newState.p = fullNominalState.segment(4, 3);
     newState.v = fullNominalState.segment(7, 3);
+    newState.slot = __builtin_ctz(~clone_slot_mask);    // lowest free clone slot
+    clone_slot_mask |= 1u << newState.slot;
+    feature_table.resetClone(newState.slot);
     
     slidingWindow.push_back(newState);
     
     Jpi.block<3,3>(0, 0) = Matrix3d::Identity(3, 3);
     Jpi.block<3,3>(3, 3) = Matrix3d::Identity(3, 3);
     Jpi.block<3,3>(6, 6) = Matrix3d::Identity(3, 3);
-    tmpCovariance.block(0, 0, errorStateLength, errorStateLength) = fullErrorCovariance;
-    tmpCovariance.block(errorStateLength, 0, 9, errorStateLength) = Jpi * fullErrorCovariance;
-    tmpCovariance.block(0, errorStateLength, errorStateLength, 9) = fullErrorCovariance * Jpi.transpose();
-    tmpCovariance.block<ERROR_POSE_STATE_SIZE, ERROR_POSE_STATE_SIZE>(errorStateLength, errorStateLength) =
-        Jpi * fullErrorCovariance * Jpi.transpose();
+    
+    // the new clone goes after the last clone, landmarks (if any) move back by one block
+    int m = errorStateLength - 3 * (int)landmark_ids.size();
+    int l = errorStateLength - m;
+    MatrixXd PJt = fullErrorCovariance * Jpi.transpose();
+    tmpCovariance.block(0, 0, m, m) = fullErrorCovariance.block(0, 0, m, m);
+    tmpCovariance.block(0, m + 9, m, l) = fullErrorCovariance.block(0, m, m, l);
+    tmpCovariance.block(m + 9, 0, l, m) = fullErrorCovariance.block(m, 0, l, m);
+    tmpCovariance.block(m + 9, m + 9, l, l) = fullErrorCovariance.block(m, m, l, l);
+    tmpCovariance.block(0, m, m, 9) = PJt.topRows(m);
+    tmpCovariance.block(m + 9, m, l, 9) = PJt.bottomRows(l);
+    tmpCovariance.block(m, 0, 9, m) = PJt.topRows(m).transpose();
+    tmpCovariance.block(m, m + 9, 9, l) = PJt.bottomRows(l).transpose();
+    tmpCovariance.block<ERROR_POSE_STATE_SIZE, ERROR_POSE_STATE_SIZE>(m, m) = Jpi * PJt;
     
     fullErrorCovariance = tmpCovariance;
 }
 
-void MSCKF::addFeatures(const vector<pair<int, Vector3d>> &image)
+void MSCKF::addFeatures(const vector<pair<int, Vector3d>> &image, const vector<pair<int, Vector3d>> &image_right)
 {
-    // add features to the feature record
+    // image_right is a subset of image in the same order
+    auto itr_right = image_right.begin();
+    
+    // add features to the feature record, under the clone slot of the newest frame
+    int clone_slot = slidingWindow.back().slot;
     for (auto & id_pts : image)
     {
         int   id = id_pts.first;
@@ -560,15 +770,22 @@ void MSCKF::addFeatures(const vector<pair<int, Vector3d>> &image)
         double y = id_pts.second(1);
         double z = id_pts.second(2);
         
-        // this is a new feature record
-        if (feature_record_dict.find(id) == feature_record_dict.end())
+        FeatureInformation feature_point(Vector3d(x, y, z));
+        if (itr_right != image_right.end() && itr_right->first == id)
         {
-            feature_record_dict[id] = FeatureRecord(current_frame, Vector3d(x, y, z));
+            feature_point = FeatureInformation(Vector3d(x, y, z), itr_right->second);
+            itr_right++;
+        }
+        
+        int slot = feature_table.find(id);
+        if (slot < 0) // this is a new feature record
+        {
+            feature_table.insert(id, current_frame, clone_slot, feature_point);
         }
         else // append to existing record
         {
-            feature_record_dict[id].feature_points.push_back(FeatureInformation(Vector3d(x, y, z)));
-            feature_record_dict[id].is_lost = false;
+            feature_table.addObservation(slot, clone_slot, feature_point);
+            feature_table.is_lost[slot] = false;
         }
     }
     
@@ -648,40 +865,205 @@ void MSCKF::removeSlideState(int index, int total)
     {
         itr++;
     }
+    clone_slot_mask &= ~(1u << itr->slot);
     slidingWindow.erase(itr);
 }
 
-void MSCKF::removeFrameFeatures(int index)
+// the update cost grows about with the cube of the window size, the window shrinks by one clone
+// when the smoothed time is over the deadline and grows by one when the bigger window is expected
+// to stay clear of it, the clones above a smaller window are marginalized by the next processImage
+void MSCKF::adaptWindowSize(double t_process)
+{
+    if (window_deadline <= 0.0)
+    {
+        return;
+    }
+    
+    process_time = process_time < 0.0 ? t_process : 0.8 * process_time + 0.2 * t_process;
+    int min_window_size = use_stereo ? 2 : 4;
+    double w = window_size;
+    if (process_time > window_deadline && window_size > min_window_size)
+    {
+        ROS_INFO("window size %d, %.1lf ms per image over the %.1lf ms deadline", window_size - 1, process_time, window_deadline);
+        window_size--;
+        process_time *= pow((w - 1) / w, 3);
+    }
+    else if (window_size < SLIDING_WINDOW_SIZE && current_frame >= window_size - 1 &&
+             process_time * pow((w + 1) / w, 3) < 0.8 * window_deadline)
+    {
+        // grow only from a full window, a partly filled one underestimates the cost
+        window_size++;
+        process_time *= pow((w + 1) / w, 3);
+        ROS_INFO("window size %d", window_size);
+    }
+}
+
+bool MSCKF::detectStationary(const vector<pair<int, Vector3d>> &image)
 {
-    list<int> id_to_remove;
-    id_to_remove.clear();
-    for (auto & item : feature_record_dict)
+    if (zupt_imu_window <= 0 || (int)zupt_acc.size() < zupt_imu_window || current_frame < 0)
+    {
+        return false;
+    }
+    
+    // IMU: per axis sample std over the window
+    Vector3d acc_mean = Vector3d::Zero(), gyro_mean = Vector3d::Zero();
+    for (int i = 0; i < zupt_imu_window; i++)
+    {
+        acc_mean += zupt_acc[i];
+        gyro_mean += zupt_gyro[i];
+    }
+    acc_mean /= zupt_imu_window;
+    gyro_mean /= zupt_imu_window;
+    Vector3d acc_var = Vector3d::Zero(), gyro_var = Vector3d::Zero();
+    for (int i = 0; i < zupt_imu_window; i++)
+    {
+        acc_var += (zupt_acc[i] - acc_mean).cwiseAbs2();
+        gyro_var += (zupt_gyro[i] - gyro_mean).cwiseAbs2();
+    }
+    acc_var /= zupt_imu_window;
+    gyro_var /= zupt_imu_window;
+    if (acc_var.maxCoeff() > zupt_acc_std * zupt_acc_std || gyro_var.maxCoeff() > zupt_gyro_std * zupt_gyro_std)
+    {
+        return false;
+    }
+    
+    // vision: mean motion of the tracked features since the newest clone
+    int clone_slot = slidingWindow.back().slot;
+    double sum = 0.0;
+    int num = 0;
+    for (auto & id_pts : image)
     {
-        if (item.second.start_frame < index)
+        int slot = feature_table.find(id_pts.first);
+        if (slot >= 0 && feature_table.tracks[slot].has(clone_slot))
         {
-            item.second.feature_points.erase(
-                item.second.feature_points.begin() + (index - item.second.start_frame)
-            );
+            const Vector3d &point = feature_table.tracks[slot].obs[clone_slot].point;
+            sum += hypot(id_pts.second(0) - point(0), id_pts.second(1) - point(1));
+            num++;
         }
-        else if (item.second.start_frame == index)
+    }
+    // no tracked feature: the image alone cannot tell
+    return num > 0 && sum / num < zupt_pixel_motion;
+}
+
+// v = 0 and gyro reading = gyro bias, 6 rows on the contiguous (v, bg) block of the error state
+void MSCKF::zeroVelocityUpdate()
+{
+    const int index = 6;
+    Vector3d gyro_mean = Vector3d::Zero();
+    for (auto & w : zupt_gyro)
+    {
+        gyro_mean += w;
+    }
+    gyro_mean /= (double)zupt_gyro.size();
+    
+    VectorXd r(6);
+    r.head(3) = -fullNominalState.segment(7, 3);
+    r.tail(3) = gyro_mean - fullNominalState.segment(10, 3);
+    
+    // velocity: the accelerometer std integrated over one sample period is well below this
+    Matrix<double, 6, 6> Rq = Matrix<double, 6, 6>::Zero();
+    Rq.diagonal().head(3).setConstant(1e-4);
+    Rq.diagonal().tail(3).setConstant(max(zupt_gyro_std * zupt_gyro_std / zupt_gyro.size(), 1e-8));
+    
+    // H selects the block, so P H^T is a column block of P
+    MatrixXd PHt = fullErrorCovariance.middleCols(index, 6);
+    Matrix<double, 6, 6> S = PHt.middleRows(index, 6) + Rq;
+    MatrixXd K = PHt * S.inverse();
+    fullErrorCovariance -= K * PHt.transpose();
+    fullErrorCovariance = 0.5 * (fullErrorCovariance + fullErrorCovariance.transpose());
+    
+    correctNominalState(K * r);
+}
+
+void MSCKF::marginalizeClone(int index)
+{
+    removeFrameFeatures(index);
+    removeSlideState(index, current_frame + 1);
+    current_frame--;
+}
+
+// motion between two clones relative to the keyframe thresholds, >= 1 means a keyframe,
+// always 1 if the policy is off
+double MSCKF::cloneMotion(const SlideState &a, const SlideState &b)
+{
+    if (keyframe_rotation <= 0.0 && keyframe_translation <= 0.0 && keyframe_parallax <= 0.0)
+    {
+        return 1.0;
+    }
+    
+    double motion = 0.0;
+    if (keyframe_rotation > 0.0)
+    {
+        Matrix3d R_ab = quaternion_to_R(a.q).transpose() * quaternion_to_R(b.q);
+        double angle = acos(max(-1.0, min(1.0, (R_ab.trace() - 1.0) / 2.0)));
+        motion = max(motion, angle / keyframe_rotation);
+    }
+    if (keyframe_translation > 0.0)
+    {
+        motion = max(motion, (b.p - a.p).norm() / keyframe_translation);
+    }
+    if (keyframe_parallax > 0.0)
+    {
+        motion = max(motion, feature_table.cloneParallax(a.slot, b.slot) / keyframe_parallax);
+    }
+    return motion;
+}
+
+// clone to drop from a full window: the one whose neighbours are closest to each other,
+// the first and the newest clone are kept, the FIFO policy drops clone 1
+int MSCKF::leastInformativeClone()
+{
+    if (current_frame < 2 || (keyframe_rotation <= 0.0 && keyframe_translation <= 0.0 && keyframe_parallax <= 0.0))
+    {
+        return 1;
+    }
+    
+    int index = 1;
+    double min_motion = 0.0;
+    std::list<SlideState>::iterator itr_prev = slidingWindow.begin();
+    std::list<SlideState>::iterator itr_next = std::next(itr_prev, 2);
+    for (int i = 1; i < current_frame; i++, itr_prev++, itr_next++)
+    {
+        double motion = cloneMotion(*itr_prev, *itr_next);
+        if (i == 1 || motion < min_motion)
+        {
+            index = i;
+            min_motion = motion;
+        }
+    }
+    return index;
+}
+
+// call before removeSlideState(index, ...), the clone slot of frame index is looked up in the window
+void MSCKF::removeFrameFeatures(int index)
+{
+    std::list<SlideState>::iterator itr = slidingWindow.begin();
+    for (int idx = 0; idx < index; idx++)
+    {
+        itr++;
+    }
+    int clone_slot = itr->slot;
+    
+    // walk backwards, remove() moves the last slot into the removed one
+    for (int k = feature_table.size() - 1; k >= 0; k--)
+    {
+        // features starting after the removed frame shift down by one,
+        // the others just lose their observation in it (if any)
+        if (feature_table.start_frame[k] > index)
         {
-            item.second.feature_points.erase(item.second.feature_points.begin());
+            feature_table.start_frame[k]--;
         }
         else
         {
-            item.second.start_frame = item.second.start_frame - 1;
+            feature_table.eraseObservation(k, clone_slot);
         }
         
-        if (item.second.feature_points.size() == 0)
+        // remove feature record with 0 feature information
+        if (feature_table.tracks[k].clone_mask == 0)
         {
-            id_to_remove.push_back(item.first);
+            feature_table.remove(k);
         }
     }
-    // remove feature record with 0 feature information
-    for (auto &id : id_to_remove)
-    {
-        feature_record_dict.erase(id);
-    }
 }
 
 Vector2d MSCKF::projectCamPoint(Vector3d ptr)
@@ -689,6 +1071,15 @@ Vector2d MSCKF::projectCamPoint(Vector3d ptr)
     return cam.h(ptr);
 }
 
+void MSCKF::projectCamPoints(const ArrayXd &x, const ArrayXd &y, const ArrayXd &z,
+                             ArrayXd &px, ArrayXd &py, Array<bool, Dynamic, 1> &in_image, bool is_right)
+{
+    if (is_right)
+        cam_right.projectPoints(x, y, z, px, py, in_image);
+    else
+        cam.projectPoints(x, y, z, px, py, in_image);
+}
+
 Vector2d MSCKF::projectPoint(Vector3d feature_pose, Matrix3d R_gb, Vector3d p_gb, Vector3d p_cb)
 {
     Vector2d zij;
@@ -699,34 +1090,45 @@ Vector2d MSCKF::projectPoint(Vector3d feature_pose, Matrix3d R_gb, Vector3d p_gb
 
 /*
  *   frame_offset: used to place HxBj in right place in H
+ *   measure_right, stereo_mask: right camera measurement of frame j if stereo_mask[j],
+ *                               its two rows are stacked after all left camera rows
  */
-bool MSCKF::getResidualH(VectorXd& ri, MatrixXd& Hi, Vector3d feature_pose, MatrixXd measure, MatrixXd pose_mtx, int frame_offset)
+bool MSCKF::getResidualH(VectorXd& ri, MatrixXd& Hi, Vector3d feature_pose, MatrixXd measure, MatrixXd pose_mtx, int frame_offset,
+                         const MatrixXd &measure_right, const vector<bool> &stereo_mask,
+                         VectorXd *r_f, MatrixXd *H_fx, Matrix3d *H_ff)
 {
     int num_frame = (int)pose_mtx.cols();
+    int num_stereo = (int)count(stereo_mask.begin(), stereo_mask.end(), true);
+    int num_row = 2 * (num_frame + num_stereo);
+    int row_right = 2 * num_frame;
     int errorStateLength = (int)fullErrorCovariance.rows();
     
-    ri = VectorXd::Zero(2 * num_frame);
-    Hi = MatrixXd::Zero(2 * num_frame, errorStateLength);    // Hi cols == error state length
+    ri = VectorXd::Zero(num_row);
+    Hi = MatrixXd::Zero(num_row, errorStateLength);    // Hi cols == error state length
     
-    MatrixXd HxBj, Hc;
-    MatrixXd Mij, tmp39;
+    Matrix<double, 2, 9> HxBj;
+    Matrix<double, 2, 3> Hc, Mij;
+    Matrix<double, 3, 9> tmp39;
     
     MatrixXd Hfi;
-    MatrixXd Hf; // use double precision to increase numerial result
-    Hfi = MatrixXd::Zero(2 * num_frame, 3);
+    Matrix<double, 2, 3> Hf; // use double precision to increase numerial result
+    Hfi = MatrixXd::Zero(num_row, 3);
     
     for(int j = 0; j < num_frame; j++)
     {
-        cout << "frame is " << frame_offset+j << endl;
-        Matrix3d R_gb = quaternion_to_R(pose_mtx.block<4, 1>(0, j));
+        // pose_mtx holds camera poses, the clones are body poses
+        Matrix3d R_gc = quaternion_to_R(pose_mtx.block<4, 1>(0, j));
+        Matrix3d R_gb = R_gc * R_cb;
+        Vector3d p_gb = pose_mtx.block<3, 1>(4, j) + R_gc * fullNominalState.segment(16, 3);
 
         //double xx = pts[i * 3 + 0] - position(0);
         //double yy = pts[i * 3 + 1] - position(1);
         //double zz = pts[i * 3 + 2] - position(2);
         //Vector3d local_point = Ric.inverse() * (quat.inverse() * Vector3d(xx, yy, zz) - Tic);
-        Vector3d feature_in_c = R_cb * R_gb.transpose() * (feature_pose - pose_mtx.block<3, 1>(4, j)) + fullNominalState.segment(16, 3);
+        Vector3d feature_in_c = R_cb * R_gb.transpose() * (feature_pose - p_gb) + fullNominalState.segment(16, 3);
         //Vector2d projPtr = projectPoint(feature_pose, R_gb, pose_mtx.block<3, 1>(4, j), fullNominalState.segment(16, 3));
         Vector2d projPtr;
+        Matrix<double, 2, 3> Jcam;
         if (feature_in_c(2) < 1e-4)
         {
           projPtr = measure.col(j);
@@ -734,35 +1136,57 @@ bool MSCKF::getResidualH(VectorXd& ri, MatrixXd& Hi, Vector3d feature_pose, Matr
         }
         else
         {
-          projPtr = projectCamPoint(feature_in_c);
+          cam.projectWithJacobian(feature_in_c, projPtr, Jcam);
         }
         if (projPtr(0)<0 || projPtr(1)>800 || projPtr(1)<0||projPtr(1)>800)
           return false;
 
-        cout << "measure is " << measure.col(j).transpose() << endl;
-        cout << "feature in c is " << feature_in_c.transpose() << endl;
-        cout << "estimat is " << projPtr << endl;
         ri.segment(j * 2, 2) = measure.col(j) - projPtr;
         
-        Mij = cam.Jh(feature_in_c) * R_cb * R_gb.transpose();
-        tmp39 = MatrixXd::Zero(3, 9);
-        tmp39.block<3, 3>(0, 0) = skew_mtx(feature_pose - pose_mtx.block<3, 1>(4, j));
+        Mij = Jcam * R_cb * R_gb.transpose();
+        tmp39 = Matrix<double, 3, 9>::Zero();
+        tmp39.block<3, 3>(0, 0) = skew_mtx(feature_pose - p_gb);
         tmp39.block<3, 3>(0, 3) = -Matrix3d::Identity();
         
         HxBj = Mij * tmp39;                           // 2x9
-        Hc = cam.Jh(feature_in_c);   // 2x3
-        cout << "HxBj is " << HxBj << endl;
-        cout << "Hc is " << Hc << endl;
+        Hc = Jcam;   // 2x3
         
         Hi.block<2, 9>(j * 2, ERROR_STATE_SIZE + 3 + ERROR_POSE_STATE_SIZE * (frame_offset + j)) = HxBj;
         Hi.block<2, 3>(j * 2, ERROR_STATE_SIZE) = Hc;
         
-        Hf = cam.Jh(feature_pose) * R_cb * R_gb.transpose();
-        Hfi.block<2, 3>(j * 2, 0) = Hf.cast<double>();
+        // feature jacobian is taken at the camera frame point, same as Hc
+        Hf = Mij;
+        Hfi.block<2, 3>(j * 2, 0) = Hf;
+        
+        if (j < (int)stereo_mask.size() && stereo_mask[j])
+        {
+            // right camera sees p_r = R_rl * p_l + t_rl
+            Vector3d feature_in_r = R_rl * feature_in_c + t_rl;
+            if (feature_in_r(2) < 1e-4)
+                return false;
+            cam_right.projectWithJacobian(feature_in_r, projPtr, Jcam);
+            ri.segment(row_right, 2) = measure_right.col(j) - projPtr;
+            
+            Hc = Jcam * R_rl;
+            Mij = Hc * R_cb * R_gb.transpose();
+            Hi.block<2, 9>(row_right, ERROR_STATE_SIZE + 3 + ERROR_POSE_STATE_SIZE * (frame_offset + j)) = Mij * tmp39;
+            Hi.block<2, 3>(row_right, ERROR_STATE_SIZE) = Hc;
+            Hfi.block<2, 3>(row_right, 0) = Mij;
+            row_right += 2;
+        }
     }
     // now carry out feature error marginalization
     JacobiSVD<MatrixXd> svd(Hfi.transpose(), ComputeFullV);
-    MatrixXd left_null = svd.matrixV().cast<double>().rightCols(2 * num_frame - 3).transpose();
+    MatrixXd left_null = svd.matrixV().cast<double>().rightCols(num_row - 3).transpose();
+    
+    if (r_f != NULL && H_fx != NULL && H_ff != NULL)
+    {
+        // the first 3 columns of V span the feature jacobian
+        MatrixXd Q1t = svd.matrixV().leftCols(3).transpose();
+        *r_f = Q1t * ri;
+        *H_fx = Q1t * Hi;
+        *H_ff = Q1t * Hfi;
+    }
     
 //    MatrixXd S = svd.singularValues().asDiagonal();
 //    MatrixXd U = svd.matrixU();
@@ -788,6 +1212,450 @@ bool MSCKF::getResidualH(VectorXd& ri, MatrixXd& Hi, Vector3d feature_pose, Matr
 }
 
 
+// Mahalanobis test of one feature on its compressed block, the Cholesky of
+// S = Hi P Hi^T + sigma^2 I is kept for scoring. Hi is only nonzero in the p_cb
+// columns and in the clones first_clone..first_clone+num_clones-1, so S comes
+// from those blocks of P alone.
+bool MSCKF::gatingTest(const VectorXd &ri, const MatrixXd &Hi, int first_clone, int num_clones, LLT<MatrixXd> &S_llt)
+{
+    int dof = (int)ri.size();
+    int clone_index = ERROR_STATE_SIZE + 3 + ERROR_POSE_STATE_SIZE * first_clone;
+    int clone_cols = ERROR_POSE_STATE_SIZE * num_clones;
+    
+    MatrixXd H_p = Hi.middleCols<3>(ERROR_STATE_SIZE);
+    MatrixXd H_c = Hi.middleCols(clone_index, clone_cols);
+    MatrixXd PHt_p = fullErrorCovariance.block<3, 3>(ERROR_STATE_SIZE, ERROR_STATE_SIZE) * H_p.transpose() +
+                     fullErrorCovariance.block(ERROR_STATE_SIZE, clone_index, 3, clone_cols) * H_c.transpose();
+    MatrixXd PHt_c = fullErrorCovariance.block(clone_index, ERROR_STATE_SIZE, clone_cols, 3) * H_p.transpose() +
+                     fullErrorCovariance.block(clone_index, clone_index, clone_cols, clone_cols) * H_c.transpose();
+    MatrixXd S = H_p * PHt_p + H_c * PHt_c;
+    S.diagonal().array() += measure_noise*measure_noise;
+    S_llt.compute(S);
+    if (S_llt.info() != Success)
+    {
+        return false;
+    }
+    double gamma = S_llt.matrixL().solve(ri).squaredNorm();
+    if (dof >= (int)chi_square_table.size())
+    {
+        return gamma < chi_square_inv(gating_confidence, dof);
+    }
+    return gamma < chi_square_table[dof];
+}
+
+void MSCKF::measurementUpdate(const MatrixXd &H, const VectorXd &r)
+{
+    int row_H = (int)H.rows();
+    int col_H = (int)H.cols();
+    VectorXd delta_x;
+    // when there are a lot of features, use QR of H to speed up computation
+    //if (H.rows()>H.cols())
+    if (0)
+    {
+        HouseholderQR<MatrixXd> qr(H.cast<double>());
+        MatrixXd R = qr.matrixQR().triangularView<Upper>();
+        MatrixXd Q = qr.householderQ();
+        MatrixXd Th = R.topRows(col_H).cast<double>();
+        MatrixXd Q1 = Q.leftCols(col_H).cast<double>();
+        
+        /* 3. calculate Kalman gain */
+        MatrixXd Rq = MatrixXd::Identity(row_H, row_H) * measure_noise*measure_noise;
+        MatrixXd tmpK = (Th * fullErrorCovariance * Th.transpose() + Rq).inverse();
+        MatrixXd K = fullErrorCovariance * Th.transpose() * tmpK;
+    
+        /* 4. update error covariance */
+        MatrixXd ImKH = MatrixXd::Identity(col_H, col_H) - K * Th;
+        fullErrorCovariance = ImKH * fullErrorCovariance * ImKH.transpose() + K * Rq * K.transpose();
+    
+        delta_x = K * Q1.transpose() * r;
+    }
+    else
+    {
+        MatrixXd Rq = MatrixXd::Identity(row_H, row_H) * measure_noise*measure_noise;
+        //ROS_INFO("H matrix");
+        //cout << H << endl;
+        MatrixXd tmpK = (H * fullErrorCovariance * H.transpose() + Rq).inverse();
+        MatrixXd K = fullErrorCovariance * H.transpose() * tmpK;
+        //ROS_INFO("K matrix");
+        //cout << K << endl;
+        MatrixXd ImKH = MatrixXd::Identity(col_H, col_H) - K * H;
+        fullErrorCovariance = ImKH * fullErrorCovariance*ImKH.transpose() + K * Rq * K.transpose();
+        fullErrorCovariance = 0.5 * (fullErrorCovariance + fullErrorCovariance.transpose());
+        //ROS_INFO("r");
+        //cout << r.transpose() << endl;
+        delta_x = K * r;
+    }
+    
+    
+    ROS_INFO("A correction calculated");
+    correctNominalState(delta_x);
+}
+
+int MSCKF::landmarkIndex()
+{
+    return (int)fullErrorCovariance.rows() - 3 * (int)landmark_ids.size();
+}
+
+// marginalize landmark j: drop its block from the covariance
+void MSCKF::removeLandmark(int j)
+{
+    int n = (int)fullErrorCovariance.rows();
+    int index = landmarkIndex() + 3*j;
+    int tail = n - index - 3;
+    MatrixXd tmpCovariance(n - 3, n - 3);
+    tmpCovariance.topLeftCorner(index, index) = fullErrorCovariance.topLeftCorner(index, index);
+    tmpCovariance.topRightCorner(index, tail) = fullErrorCovariance.topRightCorner(index, tail);
+    tmpCovariance.bottomLeftCorner(tail, index) = fullErrorCovariance.bottomLeftCorner(tail, index);
+    tmpCovariance.bottomRightCorner(tail, tail) = fullErrorCovariance.bottomRightCorner(tail, tail);
+    fullErrorCovariance = tmpCovariance;
+    
+    landmark_index_of.erase(landmark_ids[j]);
+    landmark_ids.erase(landmark_ids.begin() + j);
+    landmark_pos.erase(landmark_pos.begin() + j);
+    for (int k = j; k < (int)landmark_ids.size(); k++)
+    {
+        landmark_index_of.assign(landmark_ids[k], k);
+    }
+}
+
+/*
+ *   split image into landmark observations and ordinary features, marginalize the
+ *   landmarks that are not seen any more and update with the others, 2 rows each
+ *   (left camera) in the newest clone
+ */
+void MSCKF::updateLandmarks(const vector<pair<int, Vector3d>> &image, const vector<pair<int, Vector3d>> &image_right,
+                            vector<pair<int, Vector3d>> &image_feature, vector<pair<int, Vector3d>> &image_right_feature)
+{
+    int num_landmarks = (int)landmark_ids.size();
+    vector<int> landmark_obs(num_landmarks, -1);    // index in image
+    for (int i = 0; i < (int)image.size(); i++)
+    {
+        int j = landmark_index_of.find(image[i].first);
+        if (j >= 0)
+            landmark_obs[j] = i;
+        else
+            image_feature.push_back(image[i]);
+    }
+    for (auto & id_pts : image_right)
+    {
+        if (landmark_index_of.find(id_pts.first) < 0)
+            image_right_feature.push_back(id_pts);
+    }
+    
+    for (int j = num_landmarks - 1; j >= 0; j--)
+    {
+        if (landmark_obs[j] < 0)
+        {
+            ROS_INFO("landmark %d lost", landmark_ids[j]);
+            removeLandmark(j);
+            landmark_obs.erase(landmark_obs.begin() + j);
+        }
+    }
+    num_landmarks = (int)landmark_ids.size();
+    if (num_landmarks == 0)
+    {
+        return;
+    }
+    
+    // newest clone
+    Matrix3d R_gb = quaternion_to_R(slidingWindow.back().q);
+    Vector3d p_gb = slidingWindow.back().p;
+    
+    int col_H = (int)fullErrorCovariance.rows();
+    int clone_index = ERROR_STATE_SIZE + 3 + ERROR_POSE_STATE_SIZE * current_frame;
+    int landmark_index = landmarkIndex();
+    MatrixXd H = MatrixXd::Zero(2 * num_landmarks, col_H);
+    VectorXd r = VectorXd::Zero(2 * num_landmarks);
+    vector<int> outliers;
+    int row = 0;
+    
+    // same measurement model as getResidualH
+    Matrix<double, 2, 3> Jcam, Mij;
+    Matrix<double, 3, 9> tmp39 = Matrix<double, 3, 9>::Zero();
+    tmp39.block<3, 3>(0, 3) = -Matrix3d::Identity();
+    Vector2d projPtr;
+    for (int j = 0; j < num_landmarks; j++)
+    {
+        Vector3d feature_in_c = R_cb * R_gb.transpose() * (landmark_pos[j] - p_gb) + fullNominalState.segment(16, 3);
+        if (feature_in_c(2) < 1e-4)
+        {
+            outliers.push_back(j);
+            continue;
+        }
+        cam.projectWithJacobian(feature_in_c, projPtr, Jcam);
+        Mij = Jcam * R_cb * R_gb.transpose();
+        tmp39.block<3, 3>(0, 0) = skew_mtx(landmark_pos[j] - p_gb);
+        
+        H.middleRows(row, 2).setZero();
+        H.block<2, 9>(row, clone_index) = Mij * tmp39;
+        H.block<2, 3>(row, ERROR_STATE_SIZE) = Jcam;
+        H.block<2, 3>(row, landmark_index + 3*j) = Mij;
+        r.segment<2>(row) = image[landmark_obs[j]].second.head<2>() - projPtr;
+        
+        // 2 dof chi-square test
+        Matrix2d S = H.middleRows(row, 2) * fullErrorCovariance * H.middleRows(row, 2).transpose();
+        S.diagonal().array() += measure_noise*measure_noise;
+        if (r.segment<2>(row).dot(S.ldlt().solve(r.segment<2>(row))) >= chi_square_table[2])
+        {
+            outliers.push_back(j);
+            continue;
+        }
+        row += 2;
+    }
+    
+    if (row > 0)
+    {
+        measurementUpdate(H.topRows(row), r.head(row));
+    }
+    
+    for (int i = (int)outliers.size() - 1; i >= 0; i--)
+    {
+        ROS_INFO("landmark %d rejected", landmark_ids[outliers[i]]);
+        removeLandmark(outliers[i]);
+    }
+}
+
+/*
+ *   promote the longest live tracks into the state. The track rows along the feature
+ *   jacobian initialize the landmark and its correlations, the nullspace rows update
+ *   the state as a normal MSCKF measurement, so no information is used twice.
+ */
+void MSCKF::promoteLandmarks()
+{
+    int num_free = max_landmarks - (int)landmark_ids.size();
+    if (num_free <= 0)
+    {
+        return;
+    }
+    
+    // live tracks that span (almost) the whole window, longest first
+    int newest_slot = slidingWindow.back().slot;
+    int min_frame = max(3, window_size - 1);
+    vector<pair<int, int>> long_tracks;     // (num_frame, feature slot)
+    for (int k = 0; k < feature_table.size(); k++)
+    {
+        int num_frame = current_frame - feature_table.start_frame[k] + 1;
+        if (!feature_table.is_used[k] && feature_table.tracks[k].has(newest_slot) && num_frame >= min_frame)
+        {
+            long_tracks.push_back(make_pair(num_frame, k));
+        }
+    }
+    sort(long_tracks.begin(), long_tracks.end(), greater<pair<int, int>>());
+    
+    MatrixXd measure_mtx, measure_right, pose_mtx;
+    vector<bool> stereo_mask;
+    vector<int> promoted;
+    for (auto & long_track : long_tracks)
+    {
+        if ((int)promoted.size() >= num_free)
+        {
+            break;
+        }
+        int k = long_track.second;
+        buildMeasurement(k, long_track.first, measure_mtx, pose_mtx, measure_right, stereo_mask);
+        
+        Vector3d ptr_pose;
+        if (count(stereo_mask.begin(), stereo_mask.end(), true) > 0)
+            ptr_pose = triangulateStereo(measure_mtx, pose_mtx, measure_right, stereo_mask);
+        else
+            ptr_pose = cam.triangulate(measure_mtx, pose_mtx);
+        if (!ptr_pose.allFinite())
+        {
+            continue;
+        }
+        
+        VectorXd ri, r_f;
+        MatrixXd Hi, H_fx;
+        Matrix3d H_ff;
+        LLT<MatrixXd> S_llt;
+        if (!getResidualH(ri, Hi, ptr_pose, measure_mtx, pose_mtx, feature_table.start_frame[k],
+                          measure_right, stereo_mask, &r_f, &H_fx, &H_ff) ||
+            !gatingTest(ri, Hi, feature_table.start_frame[k], (int)pose_mtx.cols(), S_llt))
+        {
+            continue;
+        }
+        FullPivLU<Matrix3d> lu(H_ff);
+        if (!lu.isInvertible())
+        {
+            continue;   // no parallax, the depth is not observable yet
+        }
+        
+        /* delta_f = H_ff^-1 (r_f - H_fx delta_x - n_f) */
+        int n = (int)fullErrorCovariance.rows();
+        Matrix3d H_ff_inv = lu.inverse();
+        MatrixXd P_fx = -H_ff_inv * H_fx * fullErrorCovariance;
+        MatrixXd S_f = H_fx * fullErrorCovariance * H_fx.transpose();
+        S_f.diagonal().array() += measure_noise*measure_noise;
+        MatrixXd tmpCovariance(n + 3, n + 3);
+        tmpCovariance.topLeftCorner(n, n) = fullErrorCovariance;
+        tmpCovariance.bottomLeftCorner(3, n) = P_fx;
+        tmpCovariance.topRightCorner(n, 3) = P_fx.transpose();
+        tmpCovariance.bottomRightCorner<3, 3>() = H_ff_inv * S_f * H_ff_inv.transpose();
+        fullErrorCovariance = tmpCovariance;
+        landmark_index_of.insert(feature_table.ids[k], (int)landmark_ids.size());
+        landmark_ids.push_back(feature_table.ids[k]);
+        landmark_pos.push_back(ptr_pose + H_ff_inv * r_f);
+        
+        // the rest of the track, the landmark columns are zero
+        MatrixXd H = MatrixXd::Zero(ri.size(), n + 3);
+        H.leftCols(n) = Hi;
+        measurementUpdate(H, ri);
+        
+        ROS_INFO("feature %d promoted to landmark over %d frames", feature_table.ids[k], long_track.first);
+        promoted.push_back(feature_table.ids[k]);
+    }
+    
+    // the observations now belong to the landmark
+    for (auto & id : promoted)
+    {
+        feature_table.remove(feature_table.find(id));
+    }
+}
+
+double MSCKF::scoreMeasurement(const VectorXd &ri, const MatrixXd &Hi, int first_clone, int num_clones,
+                               const MatrixXd &measure, const LLT<MatrixXd> &S_llt)
+{
+    int rows = (int)ri.size();
+    if (max_update_rows == 0 && update_time_budget == 0)
+    {
+        return 0.0;   // everything is kept, no need to rank
+    }
+    
+    if (selection_score == SCORE_TRACK_PARALLAX)
+    {
+        // longer tracks with a wider baseline constrain more
+        double parallax = (measure.rightCols<1>() - measure.leftCols<1>()).norm();
+        return (double)measure.cols() * parallax;
+    }
+    
+    // tr(P Hi^T S^-1 Hi P), the trace reduction this measurement alone
+    // would give, divided by the rows it takes from the budget.
+    // P Hi^T from the columns Hi is nonzero in, as in gatingTest
+    int clone_index = ERROR_STATE_SIZE + 3 + ERROR_POSE_STATE_SIZE * first_clone;
+    int clone_cols = ERROR_POSE_STATE_SIZE * num_clones;
+    MatrixXd PHt = fullErrorCovariance.middleCols<3>(ERROR_STATE_SIZE) * Hi.middleCols<3>(ERROR_STATE_SIZE).transpose() +
+                   fullErrorCovariance.middleCols(clone_index, clone_cols) * Hi.middleCols(clone_index, clone_cols).transpose();
+    return S_llt.matrixL().solve(PHt.transpose()).squaredNorm() / rows;
+}
+
+void MSCKF::selectMeasurements(vector<MeasurementCandidate> &candidates)
+{
+    int row_cap = update_time_budget > 0 ? update_row_cap : max_update_rows;
+    if (row_cap <= 0)
+    {
+        return;
+    }
+    int total_rows = 0;
+    for (auto & candidate : candidates)
+        total_rows += (int)candidate.r.size();
+    if (total_rows <= row_cap)
+    {
+        return;
+    }
+    
+    // best first, then take every candidate that still fits
+    sort(candidates.begin(), candidates.end(),
+         [](const MeasurementCandidate &a, const MeasurementCandidate &b) { return a.score > b.score; });
+    int num_candidates = (int)candidates.size();
+    int rows = 0;
+    int num_kept = 0;
+    for (int i = 0; i < num_candidates; i++)
+    {
+        if (rows + candidates[i].r.size() <= row_cap)
+        {
+            rows += (int)candidates[i].r.size();
+            if (num_kept != i)
+                swap(candidates[num_kept], candidates[i]);
+            num_kept++;
+        }
+    }
+    candidates.resize(num_kept);
+    ROS_INFO("update budget %d rows: kept %d of %d features, %d of %d rows",
+             row_cap, num_kept, num_candidates, rows, total_rows);
+}
+
+/*
+ *   triangulate a feature with at least one stereo observation,
+ *   initial depth from the first stereo pair, then gauss newton on the
+ *   inverse depth in the first frame over all left and right observations
+ */
+Vector3d MSCKF::triangulateStereo(const MatrixXd &measure, const MatrixXd &pose_mtx,
+                                  const MatrixXd &measure_right, const vector<bool> &stereo_mask)
+{
+    int num_frame = (int)pose_mtx.cols();
+    int num_stereo = (int)count(stereo_mask.begin(), stereo_mask.end(), true);
+    
+    Matrix3d R_wc0 = quaternion_to_R(pose_mtx.block<4, 1>(0, 0));
+    Vector3d t_wc0 = pose_mtx.block<3, 1>(4, 0);
+    
+    vector<Matrix3d> R_cic0(num_frame);
+    vector<Vector3d> t_cic0(num_frame);
+    for (int i = 0; i < num_frame; i++)
+    {
+        Matrix3d R_wci = quaternion_to_R(pose_mtx.block<4, 1>(0, i));
+        R_cic0[i] = R_wci.transpose() * R_wc0;
+        t_cic0[i] = R_wci.transpose() * (t_wc0 - pose_mtx.block<3, 1>(4, i));
+    }
+    
+    /* 1. depth along the left bearing so that R_rl * b_l * depth + t_rl is parallel to b_r */
+    int k = (int)(find(stereo_mask.begin(), stereo_mask.end(), true) - stereo_mask.begin());
+    Vector3d b_l, b_r;
+    b_l << cam.liftPoint(measure.col(k)), 1;
+    b_r << cam_right.liftPoint(measure_right.col(k)), 1;
+    
+    Matrix<double, 2, 3> nK;
+    nK << 1, 0, -b_r(0),
+          0, 1, -b_r(1);
+    Vector2d mtx_A = nK * R_rl * b_l;
+    Vector2d mtx_B = -nK * t_rl;
+    double depth = mtx_A.dot(mtx_B) / mtx_A.dot(mtx_A);
+    
+    Vector3d ptr_c0 = R_cic0[k].transpose() * (depth * b_l - t_cic0[k]);
+    Vector3d theta(ptr_c0(0)/ptr_c0(2), ptr_c0(1)/ptr_c0(2), 1.0/ptr_c0(2));
+    
+    /* 2. refine */
+    int num_row = 2 * (num_frame + num_stereo);
+    VectorXd f(num_row);
+    MatrixXd J(num_row, 3);
+    Matrix3d Jg;
+    Vector2d zi;
+    Matrix<double, 2, 3> Jhi;
+    for (int itr = 0; itr < 10; itr++)
+    {
+        int row = 0;
+        for (int i = 0; i < num_frame; i++)
+        {
+            // point in frame i scaled by the inverse depth
+            Vector3d g_ptr = R_cic0[i] * Vector3d(theta(0), theta(1), 1) + theta(2) * t_cic0[i];
+            Jg.col(0) = R_cic0[i].col(0);
+            Jg.col(1) = R_cic0[i].col(1);
+            Jg.col(2) = t_cic0[i];
+            
+            cam.projectWithJacobian(g_ptr, zi, Jhi);
+            f.segment(row, 2) = measure.col(i) - zi;
+            J.block<2, 3>(row, 0) = -Jhi * Jg;
+            row += 2;
+            
+            if (stereo_mask[i])
+            {
+                Matrix3d Jg_r = R_rl * Jg;
+                Jg_r.col(2) += t_rl;
+                cam_right.projectWithJacobian(R_rl * g_ptr + theta(2) * t_rl, zi, Jhi);
+                f.segment(row, 2) = measure_right.col(i) - zi;
+                J.block<2, 3>(row, 0) = -Jhi * Jg_r;
+                row += 2;
+            }
+        }
+        
+        Vector3d delta = (J.transpose() * J).ldlt().solve(J.transpose() * f);
+        theta = theta - delta;
+        if (delta.norm() < 1e-8)
+            break;
+    }
+    
+    return R_wc0 * Vector3d(theta(0)/theta(2), theta(1)/theta(2), 1.0/theta(2)) + t_wc0;
+}
+
 void MSCKF::printNominalState(bool is_full)
 {
     int nominalStateLength = (int)fullNominalState.size();
@@ -833,7 +1701,10 @@ void MSCKF::printSlidingWindow()
         std::cout<< itr->p(2) << " ";
         std::cout<< itr->v(0) << " ";
         std::cout<< itr->v(1) << " ";
-        std::cout<< itr->v(2) << "|";
+        std::cout<< itr->v(2) << " ";
+        // frame major view: observations in this clone and their parallax to the newest one
+        std::cout<< "(" << feature_table.columns[itr->slot].size() << " obs, ";
+        std::cout<< feature_table.cloneParallax(itr->slot, slidingWindow.back().slot) << " px)|";
     }
     std::cout<<std::endl;
 }
@@ -881,6 +1752,23 @@ Vector3d MSCKF::getAcceBias()
 {
     return fullNominalState.segment(13, 3);
 }
+
+int MSCKF::getWindowSize()
+{
+    return window_size;
+}
+
+bool MSCKF::isStationary()
+{
+    return is_stationary;
+}
+
+void MSCKF::getGatingStats(int &checked, int &rejected)
+{
+    checked = num_gated;
+    rejected = num_rejected;
+}
+
 Vector3d MSCKF::getVIOffset()
 {
     return fullNominalState.segment(16, 3);
@@ -12,6 +12,7 @@
 #include <iostream>
 #include <cmath>
 #include <list>
+#include <deque>
 #include <algorithm>
 #include <vector>
 #include <numeric>
@@ -23,14 +24,32 @@
 using namespace Eigen;
 using namespace std;
 
-#include "FeatureRecord.h"
+#include "g_param.h"
+#include "FeatureTable.h"
 #include "Camera.h"
+#include "EquidistantCamera.h"
+#include "OmniCamera.h"
 
 struct SlideState
 {
     Vector4d q;
     Vector3d p;
     Vector3d v;
+    int slot;   // clone slot, fixed while the clone stays in the window
+};
+
+// a feature measurement after nullspace projection, waiting for selection
+struct MeasurementCandidate
+{
+    VectorXd r;
+    MatrixXd H;
+    double score;
+};
+
+enum SelectionScore
+{
+    SCORE_TRACE_REDUCTION = 0,  // expected reduction of the covariance trace per row
+    SCORE_TRACK_PARALLAX  = 1   // track length times pixel parallax, no covariance product
 };
 
 class MSCKF
@@ -45,6 +64,7 @@ private:
 //    VectorXd fullErrorState;
     
     list<SlideState> slidingWindow;
+    unsigned int clone_slot_mask;   // clone slots in use
 
     /* covariance */
     MatrixXd errorCovariance;
@@ -56,14 +76,48 @@ private:
     double measure_noise;
     
     /* feature management */
-    map<int, FeatureRecord> feature_record_dict;
+    FeatureTable feature_table;
     list<VectorXd>  residual_list;
     list<MatrixXd>  H_mtx_list;
     list<int>       H_mtx_block_size_list;
     
+    /* per frame update budget, see setUpdateBudget */
+    int    max_update_rows;     // 0: no row limit
+    double update_time_budget;  // ms, 0: no time limit
+    int    update_row_cap;      // row limit derived from the time budget
+    int    selection_score;
+    
+    /* chi-square gating of each feature before stacking */
+    double gating_confidence;
+    vector<double> chi_square_table;    // gating_confidence quantile, indexed by dof
+    int num_gated;          // features tested in the last image
+    int num_rejected;       // features rejected in the last image
+    
+    /* SLAM landmarks, global positions in the state after the clones (3 error states each) */
+    int max_landmarks;      // <= MAX_SLAM_LANDMARKS, 0 disables promotion
+    vector<int> landmark_ids;
+    vector<Vector3d> landmark_pos;
+    SlotHash landmark_index_of;     // tracker id to index in landmark_ids
+    
+    /* keyframe policy for the clones, see setKeyframePolicy, all 0: plain FIFO window */
+    double keyframe_rotation;       // rad
+    double keyframe_translation;    // m
+    double keyframe_parallax;       // px
+    
+    /* zero velocity detection, see setZuptConfig */
+    int    zupt_imu_window;         // IMU samples, 0 disables the detector
+    double zupt_acc_std;            // m/s^2
+    double zupt_gyro_std;           // rad/s
+    double zupt_pixel_motion;       // px, mean feature motion since the newest clone
+    deque<Vector3d> zupt_acc, zupt_gyro;    // raw IMU samples of the last zupt_imu_window steps
+    bool   is_stationary;
+    
     
     double current_time;     // indicates the current time stamp
     int   current_frame;    // indicates the current frame in slidingWindow
+    int   window_size;      // active sliding window size, <= SLIDING_WINDOW_SIZE
+    double window_deadline; // ms per processImage the window size is adapted to, 0: fixed window
+    double process_time;    // smoothed processImage time, ms
     
     /* IMU measurements */
     Vector3d prev_w, curr_w;
@@ -78,7 +132,14 @@ private:
     Vector3d acce_bias;
     
     /* camera */    
-    DistortCamera cam;
+    CAMERA_MODEL cam;
+    UndistortMap undistort_map;
+    
+    /* right camera of a stereo rig, p_r = R_rl * p_l + t_rl */
+    bool use_stereo;
+    CAMERA_MODEL cam_right;
+    Matrix3d R_rl;
+    Vector3d t_rl;
     
     /* fixed rotation between camera and the body frame */
     Matrix3d R_cb;
@@ -88,12 +149,37 @@ private:
     void correctNominalState(VectorXd delta);
     void addSlideState();
     void removeSlideState(int index, int total);
-    void addFeatures(const vector<pair<int, Vector3d>> &image);
+    void addFeatures(const vector<pair<int, Vector3d>> &image, const vector<pair<int, Vector3d>> &image_right);
     void removeFrameFeatures(int index);
+    void marginalizeClone(int index);
+    double cloneMotion(const SlideState &a, const SlideState &b);
+    int leastInformativeClone();
+    void adaptWindowSize(double t_process);
+    bool detectStationary(const vector<pair<int, Vector3d>> &image);
+    void zeroVelocityUpdate();
     void removeUsedFeatures();
     
     Vector2d projectPoint(Vector3d feature_pose, Matrix3d R_bg, Vector3d p_gb, Vector3d p_cb);
-    bool getResidualH(VectorXd& ri, MatrixXd& Hi, Vector3d feature_pose, MatrixXd measure, MatrixXd pose_mtx, int frame_offset);
+    // r_f, H_fx, H_ff (optional): the rows along the feature jacobian left out by the nullspace projection
+    bool getResidualH(VectorXd& ri, MatrixXd& Hi, Vector3d feature_pose, MatrixXd measure, MatrixXd pose_mtx, int frame_offset,
+                      const MatrixXd &measure_right, const vector<bool> &stereo_mask,
+                      VectorXd *r_f = NULL, MatrixXd *H_fx = NULL, Matrix3d *H_ff = NULL);
+    void getCameraPose(const SlideState &state, Vector4d &q_gc, Vector3d &p_gc);
+    void buildMeasurement(int k, int num_frame, MatrixXd &measure_mtx, MatrixXd &pose_mtx,
+                          MatrixXd &measure_right, vector<bool> &stereo_mask);
+    void measurementUpdate(const MatrixXd &H, const VectorXd &r);
+    
+    int landmarkIndex();
+    void removeLandmark(int j);
+    void updateLandmarks(const vector<pair<int, Vector3d>> &image, const vector<pair<int, Vector3d>> &image_right,
+                         vector<pair<int, Vector3d>> &image_feature, vector<pair<int, Vector3d>> &image_right_feature);
+    void promoteLandmarks();
+    bool gatingTest(const VectorXd &ri, const MatrixXd &Hi, int first_clone, int num_clones, LLT<MatrixXd> &S_llt);
+    double scoreMeasurement(const VectorXd &ri, const MatrixXd &Hi, int first_clone, int num_clones,
+                            const MatrixXd &measure, const LLT<MatrixXd> &S_llt);
+    void selectMeasurements(vector<MeasurementCandidate> &candidates);
+    Vector3d triangulateStereo(const MatrixXd &measure, const MatrixXd &pose_mtx,
+                               const MatrixXd &measure_right, const vector<bool> &stereo_mask);
     
 public:
     MSCKF();
@@ -103,16 +189,42 @@ public:
     
     void processIMU(double t, Vector3d linear_acceleration, Vector3d angular_velocity);
     void processImage(const vector<pair<int, Vector3d>> &image);
+    // image_right holds the right camera measurements of the stereo matched subset of image, in the same order
+    void processImage(const vector<pair<int, Vector3d>> &image, const vector<pair<int, Vector3d>> &image_right);
     
     void setNominalState(Vector4d q, Vector3d p, Vector3d v, Vector3d bg, Vector3d ba);
-    void setCalibParam(Vector3d p_cb, double fx, double fy, double ox, double oy, double k1, double k2, double p1, double p2, double k3);
+    // dist is the distortion parameter list of CAMERA_MODEL, returns false if its size does not match
+    bool setCalibParam(Vector3d p_cb, double fx, double fy, double ox, double oy, const vector<double> &dist);
     void setIMUCameraRotation(Matrix3d _R_cb);
+    // enables the stereo measurement model
+    bool setStereoCalibParam(double fx, double fy, double ox, double oy, const vector<double> &dist,
+                             Matrix3d _R_rl, Vector3d _t_rl);
+    void setWindowSize(int _window_size);
+    // grow or shrink the window (up to SLIDING_WINDOW_SIZE) so processImage takes about deadline ms, 0 keeps it fixed
+    void setWindowDeadline(double deadline);
+    // keep at most max_rows rows (0: all) and/or aim the update at max_time_ms (0: no limit),
+    // features are ranked by score (SelectionScore) and the best ones that fit are kept
+    void setUpdateBudget(int max_rows, double max_time_ms, int score);
+    // quantile of the chi-square test on r^T (H P H^T + sigma^2 I)^-1 r, default 0.95
+    void setGatingConfidence(double confidence);
+    // keep up to _max_landmarks (<= MAX_SLAM_LANDMARKS) long tracks in the state as SLAM landmarks, 0 disables
+    void setLandmarkBudget(int _max_landmarks);
+    // a clone is a keyframe if it moved by rotation (rad), translation (m) or mean feature parallax (px)
+    // since the previous one, clones in between are dropped, all 0 keeps the FIFO window
+    void setKeyframePolicy(double rotation, double translation, double parallax);
+    // stationary if the IMU std over imu_window samples and the mean feature motion since the newest clone
+    // stay below the thresholds, then images only give a zero velocity / zero rate update, 0 disables
+    void setZuptConfig(int imu_window, double acc_std, double gyro_std, double pixel_motion);
+    // build (or load from cache_path) the pixel -> normalized plane table, call after setCalibParam
+    void initUndistortMap(int step, const string &cache_path);
     
     void setNoiseMatrix(double dgc, double dac, double dwgc, double dwac);
     void setMeasureNoise(double _noise);
 
     // test function...
     Vector2d projectCamPoint(Vector3d ptr);    
+    void projectCamPoints(const ArrayXd &x, const ArrayXd &y, const ArrayXd &z,
+                          ArrayXd &px, ArrayXd &py, Array<bool, Dynamic, 1> &in_image, bool is_right = false);
 
     /* outputs */
     Vector4d getQuaternion();
@@ -122,6 +234,10 @@ public:
     Vector3d getGyroBias();
     Vector3d getAcceBias();
     Vector3d getVIOffset();
+    // chi-square gating of the last processImage
+    void getGatingStats(int &checked, int &rejected);
+    bool isStationary();
+    int getWindowSize();
     
     
     /* debug outputs */
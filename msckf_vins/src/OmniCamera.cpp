@@ -0,0 +1,30 @@
+//
+//  OmniCamera.cpp
+//  msckf_vins
+//
+
+#include "OmniCamera.h"
+using namespace std;
+
+OmniCamera::OmniCamera()
+{
+    xi = 1.0;
+    k1 = k2 = p1 = p2 = 0.0;
+}
+
+bool OmniCamera::setDistortionParam(const vector<double> &params)
+{
+    if ((int)params.size() != NUM_DISTORTION_PARAM)
+        return false;
+    xi = params[0];
+    k1 = params[1];
+    k2 = params[2];
+    p1 = params[3];
+    p2 = params[4];
+    return true;
+}
+
+vector<double> OmniCamera::getDistortionParam() const
+{
+    return {xi, k1, k2, p1, p2};
+}
@@ -0,0 +1,68 @@
+//
+//  OmniCamera.h
+//  msckf_vins
+//
+//  unified omnidirectional model (Mei): the point is projected on the unit
+//  sphere, then through a pinhole shifted by xi along the optical axis, then
+//  distorted with radial-tangential k1, k2, p1, p2
+//
+
+#ifndef __msckf_vins__OmniCamera__
+#define __msckf_vins__OmniCamera__
+
+#include <cmath>
+#include <vector>
+#include <Eigen/Dense>
+#include "CameraModel.h"
+
+class OmniCamera : public CameraModel<OmniCamera> {
+    double xi;
+    double k1;
+    double k2;
+    double p1;
+    double p2;
+    
+public:
+    static const int NUM_DISTORTION_PARAM = 5;
+    static const char *name() { return "omni"; }
+    
+    OmniCamera();
+    bool setDistortionParam(const std::vector<double> &params);   // xi, k1, k2, p1, p2
+    std::vector<double> getDistortionParam() const;
+    
+    void spaceToPlane(const Eigen::Vector3d &ptr, Eigen::Vector2d &m, Eigen::Matrix<double, 2, 3> *J) const
+    {
+        double x = ptr(0), y = ptr(1), z = ptr(2);
+        double norm = ptr.norm();
+        double inv_d = 1.0/(z + xi*norm);
+        double u = x*inv_d;
+        double v = y*inv_d;
+        
+        if (J == NULL)
+        {
+            distortRadTan(k1, k2, p1, p2, 0.0, u, v, m, NULL);
+            return;
+        }
+        
+        Eigen::Matrix2d Jd;
+        distortRadTan(k1, k2, p1, p2, 0.0, u, v, m, &Jd);
+        
+        // d(u, v)/d(x, y, z), with dd/dP = xi*P/|P| + (0, 0, 1)
+        Eigen::Matrix<double, 2, 3> Juv;
+        double a = xi/norm;
+        Juv << inv_d - u*a*x*inv_d,     - u*a*y*inv_d, -u*(a*z + 1)*inv_d,
+                   - v*a*x*inv_d, inv_d - v*a*y*inv_d, -v*(a*z + 1)*inv_d;
+        *J = Jd*Juv;
+    }
+    
+    // only valid for rays in front of the camera (z > 0)
+    Eigen::Vector2d planeToSpace(const Eigen::Vector2d &m) const
+    {
+        Eigen::Vector2d uv = undistortRadTan(k1, k2, p1, p2, 0.0, m);
+        double r2 = uv.squaredNorm();
+        double factor = (xi + sqrt(1 + (1 - xi*xi)*r2))/(r2 + 1);
+        return uv * (factor/(factor - xi));
+    }
+};
+
+#endif /* defined(__msckf_vins__OmniCamera__) */
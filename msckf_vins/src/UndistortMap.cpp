@@ -0,0 +1,69 @@
+//
+//  UndistortMap.cpp
+//  msckf_vins
+//
+
+#include "UndistortMap.h"
+using namespace std;
+
+static const int UNDISTORT_MAP_MAGIC = 0x554d4150;   // "UMAP"
+
+bool UndistortMap::save(const string &path) const
+{
+    ofstream fout(path.c_str(), ios::binary);
+    if (!fout)
+    {
+        return false;
+    }
+    int num_params = (int)params.size();
+    fout.write((const char *)&UNDISTORT_MAP_MAGIC, sizeof(int));
+    fout.write((const char *)&width, sizeof(int));
+    fout.write((const char *)&height, sizeof(int));
+    fout.write((const char *)&step, sizeof(int));
+    fout.write((const char *)&num_params, sizeof(int));
+    fout.write((const char *)params.data(), num_params * sizeof(double));
+    fout.write((const char *)grid_x.data(), grid_x.size() * sizeof(float));
+    fout.write((const char *)grid_y.data(), grid_y.size() * sizeof(float));
+    return (bool)fout;
+}
+
+bool UndistortMap::load(const string &path)
+{
+    ifstream fin(path.c_str(), ios::binary);
+    if (!fin)
+    {
+        return false;
+    }
+    int magic, num_params;
+    fin.read((char *)&magic, sizeof(int));
+    if (!fin || magic != UNDISTORT_MAP_MAGIC)
+    {
+        return false;
+    }
+    fin.read((char *)&width, sizeof(int));
+    fin.read((char *)&height, sizeof(int));
+    fin.read((char *)&step, sizeof(int));
+    fin.read((char *)&num_params, sizeof(int));
+    if (!fin || width <= 0 || height <= 0 || step <= 0 || num_params < 0 || num_params > 64)
+    {
+        grid_x.clear();
+        grid_y.clear();
+        return false;
+    }
+    grid_cols = (width - 1) / step + 2;
+    grid_rows = (height - 1) / step + 2;
+
+    params.resize(num_params);
+    grid_x.resize(grid_cols * grid_rows);
+    grid_y.resize(grid_cols * grid_rows);
+    fin.read((char *)params.data(), num_params * sizeof(double));
+    fin.read((char *)grid_x.data(), grid_x.size() * sizeof(float));
+    fin.read((char *)grid_y.data(), grid_y.size() * sizeof(float));
+    if (!fin)
+    {
+        grid_x.clear();
+        grid_y.clear();
+        return false;
+    }
+    return true;
+}
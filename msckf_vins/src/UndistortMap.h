@@ -0,0 +1,119 @@
+//
+//  UndistortMap.h
+//  msckf_vins
+//
+//  pixel -> normalized image plane lookup table, sampled every `step` pixels
+//  and bilinearly interpolated in between, so tracked points can be lifted
+//  without running the iterative undistortion
+//
+
+#ifndef __msckf_vins__UndistortMap__
+#define __msckf_vins__UndistortMap__
+
+#include <cmath>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <Eigen/Dense>
+
+class UndistortMap
+{
+    int width;
+    int height;
+    int step;
+    int grid_cols;
+    int grid_rows;
+
+    // camera parameters the table was built with, used to validate a cache
+    std::vector<double> params;
+
+    // normalized coordinates at grid nodes, row major
+    std::vector<float> grid_x;
+    std::vector<float> grid_y;
+
+public:
+    UndistortMap(): width(0), height(0), step(0), grid_cols(0), grid_rows(0)
+    {}
+
+    bool empty() const
+    {
+        return grid_x.empty();
+    }
+
+    // Camera needs getWidth(), getHeight(), getParams() and undistortPoint(),
+    // returns false and leaves the table empty if step is not positive
+    template<typename Camera>
+    bool build(const Camera &cam, int _step)
+    {
+        if (_step <= 0)
+        {
+            grid_x.clear();
+            grid_y.clear();
+            return false;
+        }
+        width = cam.getWidth();
+        height = cam.getHeight();
+        step = _step;
+        params = cam.getParams();
+        grid_cols = (width - 1) / step + 2;
+        grid_rows = (height - 1) / step + 2;
+
+        grid_x.resize(grid_cols * grid_rows);
+        grid_y.resize(grid_cols * grid_rows);
+        for (int r = 0; r < grid_rows; r++)
+        {
+            for (int c = 0; c < grid_cols; c++)
+            {
+                Eigen::Vector2d xy = cam.undistortPoint(Eigen::Vector2d(c * step, r * step));
+                grid_x[r * grid_cols + c] = (float)xy(0);
+                grid_y[r * grid_cols + c] = (float)xy(1);
+            }
+        }
+        return true;
+    }
+
+    // load the table from cache_path if it was built for the same camera,
+    // otherwise build it and (if cache_path is not empty) write it back
+    template<typename Camera>
+    bool init(const Camera &cam, int _step, const std::string &cache_path)
+    {
+        if (!cache_path.empty() && load(cache_path) &&
+            width == cam.getWidth() && height == cam.getHeight() &&
+            step == _step && params == cam.getParams())
+        {
+            return true;
+        }
+        if (build(cam, _step) && !cache_path.empty())
+        {
+            save(cache_path);
+        }
+        return false;
+    }
+
+    bool save(const std::string &path) const;
+    bool load(const std::string &path);
+
+    // bilinear lookup, returns false outside of the table
+    bool lift(double u, double v, Eigen::Vector2d &xy) const
+    {
+        if (empty() || !(u >= 0) || !(v >= 0) || u > width - 1 || v > height - 1)
+        {
+            return false;
+        }
+        double gu = u / step;
+        double gv = v / step;
+        int c = (int)gu;
+        int r = (int)gv;
+        double a = gu - c;
+        double b = gv - r;
+        int idx = r * grid_cols + c;
+
+        xy(0) = (1-b) * ((1-a) * grid_x[idx]             + a * grid_x[idx + 1]) +
+                   b  * ((1-a) * grid_x[idx + grid_cols] + a * grid_x[idx + grid_cols + 1]);
+        xy(1) = (1-b) * ((1-a) * grid_y[idx]             + a * grid_y[idx + 1]) +
+                   b  * ((1-a) * grid_y[idx + grid_cols] + a * grid_y[idx + grid_cols + 1]);
+        return true;
+    }
+};
+
+#endif /* defined(__msckf_vins__UndistortMap__) */
@@ -30,4 +30,16 @@
 
 #endif
 
+// hard cap on SLAM landmarks kept in the state (3 error states each)
+#define MAX_SLAM_LANDMARKS 20
+
+// row cap of the first update under a time budget, before an update has been timed
+#define INITIAL_UPDATE_ROWS 100
+
+// camera model used by the filter: DistortCamera (radtan), EquidistantCamera or OmniCamera,
+// picked at compile time so the projection kernels inline into the update
+#ifndef CAMERA_MODEL
+#define CAMERA_MODEL DistortCamera
+#endif
+
 #endif
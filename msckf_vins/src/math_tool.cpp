@@ -7,6 +7,7 @@
 //
 
 #include "math_tool.h"
+#include <cmath>
 
 /* my quaternion convention
     double w = nq(0);
@@ -146,11 +147,66 @@ Vector4d quaternion_correct(Vector4d q, Vector3d d_theta)
                    );
     dq.w() = 1 - dq.vec().transpose() * dq.vec();
     
-    qf = (qf * dq).normalized();
+    qf = (dq * qf).normalized();
     corrected_q <<
-    qf.x(),qf.y(),qf.z(),qf.w();
+    qf.w(),qf.x(),qf.y(),qf.z();
     
     return corrected_q;
 }
 
+// regularized lower incomplete gamma function P(a, x)
+static double gamma_p(double a, double x)
+{
+    if (x <= 0)
+        return 0.0;
+    double gln = lgamma(a);
+    if (x < a + 1)
+    {
+        // series
+        double ap = a, sum = 1.0 / a, del = sum;
+        for (int n = 0; n < 500; n++)
+        {
+            ap += 1;
+            del *= x / ap;
+            sum += del;
+            if (fabs(del) < fabs(sum) * 1e-14)
+                break;
+        }
+        return sum * exp(-x + a * log(x) - gln);
+    }
+    else
+    {
+        // continued fraction for Q(a, x), modified Lentz
+        double b = x + 1 - a, c = 1e300, d = 1 / b, h = d;
+        for (int i = 1; i < 500; i++)
+        {
+            double an = -i * (i - a);
+            b += 2;
+            d = an * d + b;
+            if (fabs(d) < 1e-300) d = 1e-300;
+            c = b + an / c;
+            if (fabs(c) < 1e-300) c = 1e-300;
+            d = 1 / d;
+            double del = d * c;
+            h *= del;
+            if (fabs(del - 1) < 1e-14)
+                break;
+        }
+        return 1.0 - exp(-x + a * log(x) - gln) * h;
+    }
+}
 
+double chi_square_inv(double p, int dof)
+{
+    // bisection on the cdf, only used to fill lookup tables
+    double lo = 0.0, hi = dof + 10.0 * sqrt(2.0 * dof) + 10.0;
+    for (int i = 0; i < 200; i++)
+    {
+        double mid = 0.5 * (lo + hi);
+        if (gamma_p(0.5 * dof, 0.5 * mid) < p)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return 0.5 * (lo + hi);
+}
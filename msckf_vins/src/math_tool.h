@@ -17,4 +17,6 @@ Matrix3d skew_mtx(const Vector3d& w);
 Matrix4d omega_mtx(const Vector3d& w);
 Vector4d delta_quaternion(const Vector3d& w_prev, const Vector3d& w_curr, const double dt);
 Vector4d quaternion_correct(Vector4d q, Vector3d d_theta);
+// x such that P(chi2(dof) <= x) = p
+double chi_square_inv(double p, int dof);
 #endif /* defined(__MyTriangulation__math_tool__) */
@@ -0,0 +1,429 @@
+#include <queue>
+#include <atomic>
+#include <type_traits>
+#include <ros/ros.h>
+#include <sensor_msgs/Imu.h>
+#include <vins_msgs/FeatureFrame.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/image_encodings.h>
+#include <std_msgs/Int32.h>
+#include <std_msgs/Float64.h>
+#include <std_msgs/Int32MultiArray.h>
+#include <nav_msgs/Path.h>
+#include <nav_msgs/Odometry.h>
+#include <visualization_msgs/Marker.h>
+#include <tf/transform_broadcaster.h>
+#include <cv_bridge/cv_bridge.h>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/video/tracking.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+
+#include "tic_toc.h"
+#include "MSCKF.h"
+#include "math_tool.h"
+#include "msckf_vins.h"
+using namespace std;
+
+// everything in a namespace, the nodelet shares its process with the tracker.
+// The state is namespace scope, so there is one filter per process, see setup
+namespace msckf_vins
+{
+
+atomic<bool> is_setup(false);
+
+const int ROW=480;
+const int COL=752;
+const double FOCAL_LENGTH = 365.1;
+
+
+queue<sensor_msgs::Imu> imu_buf;
+    
+MSCKF my_kf;
+bool use_stereo = false;
+
+// visualize results
+nav_msgs::Path path;
+double sum_of_path = 0.0;
+Vector3d last_path(0.0, 0.0, 0.0);
+Vector4d curr_q;
+visualization_msgs::Marker path_line;
+ros::Publisher pub_odometry;
+ros::Publisher pub_path, pub_path1, pub_path2;
+ros::Publisher pub_pose, pub_pose2;
+ros::Publisher pub_gating;
+ros::Publisher pub_window_size;
+ros::Publisher pub_latency;
+ros::Subscriber sub_imu, sub_image;
+
+// camera stamp -> odometry published, ms, summed over latency_report images
+int latency_report = 100;
+int latency_cnt = 0;
+double latency_sum = 0.0, latency_max = 0.0;
+
+void imu_callback(const sensor_msgs::ImuConstPtr &imu_msg)
+{
+    imu_buf.push(*imu_msg);
+
+//    double dx = imu_msg->linear_acceleration.x;
+//    double dy = imu_msg->linear_acceleration.y;
+//    double dz = imu_msg->linear_acceleration.z;
+//
+//    double rx = imu_msg->angular_velocity.x;
+//    double ry = imu_msg->angular_velocity.y;
+//    double rz = imu_msg->angular_velocity.z;
+//
+//    my_kf.processIMU(t, Vector3d(dx, dy, dz), Vector3d(rx, ry, rz));
+}
+
+
+void send_imu(const sensor_msgs::Imu &imu_msg)
+{
+    double t = imu_msg.header.stamp.toSec();
+
+    //ROS_INFO("processing IMU data with stamp %lf", t);
+
+    double dx = imu_msg.linear_acceleration.x;
+    double dy = imu_msg.linear_acceleration.y;
+    double dz = imu_msg.linear_acceleration.z;
+
+    double rx = imu_msg.angular_velocity.x;
+    double ry = imu_msg.angular_velocity.y;
+    double rz = imu_msg.angular_velocity.z;
+
+    my_kf.processIMU(t, Vector3d(dx, dy, dz), Vector3d(rx, ry, rz));
+}
+
+void image_callback(const vins_msgs::FeatureFrameConstPtr &image_msg)
+{
+    double t = image_msg->header.stamp.toSec();
+    if (imu_buf.empty() || t < imu_buf.front().header.stamp.toSec())
+    {
+        ROS_ERROR("wait for imu data");
+        return;
+    }
+    TicToc t_s;
+    while (!imu_buf.empty() && t >= imu_buf.front().header.stamp.toSec())
+    {
+        send_imu(imu_buf.front());
+        imu_buf.pop();
+    }
+    ROS_INFO("processing vision data with stamp %lf", t);
+    int num_points = (int)image_msg->ids.size();
+    ArrayXd x(num_points), y(num_points);
+    for (int i = 0; i < num_points; i++)
+    {
+        x(i) = image_msg->x[i];
+        y(i) = image_msg->y[i];
+    }
+    ArrayXd u, v;
+    Array<bool, Dynamic, 1> in_image;
+    my_kf.projectCamPoints(x, y, ArrayXd::Ones(num_points), u, v, in_image);
+
+    vector<pair<int, Vector3d>> image;
+    for (int i = 0; i < num_points; i++)
+    {
+        int   id = image_msg->ids[i];
+        //ROS_INFO("id %d cam pos (%f, %f) project to (%f, %f)", id, x(i), y(i), u(i), v(i));
+        if (in_image(i))
+          image.push_back(make_pair(/*gr_id * 10000 + */id, Vector3d(u(i), v(i), 1)));
+    }
+
+    // stereo matches, normalized coordinates of the right camera, empty in monocular mode
+    vector<pair<int, Vector3d>> image_right;
+    if (use_stereo && (int)image_msg->right_valid.size() == num_points)
+    {
+        ArrayXd xr(num_points), yr(num_points), ur, vr;
+        Array<bool, Dynamic, 1> in_image_right;
+        for (int i = 0; i < num_points; i++)
+        {
+            xr(i) = image_msg->right_x[i];
+            yr(i) = image_msg->right_y[i];
+        }
+        my_kf.projectCamPoints(xr, yr, ArrayXd::Ones(num_points), ur, vr, in_image_right, true);
+        for (int i = 0; i < num_points; i++)
+        {
+            if (in_image(i) && in_image_right(i) && image_msg->right_valid[i])
+              image_right.push_back(make_pair((int)image_msg->ids[i], Vector3d(ur(i), vr(i), 1)));
+        }
+    }
+
+    my_kf.processImage(image, image_right);
+
+    // [features tested, features rejected] by the chi-square gating of this image,
+    // stationary images only get the zero velocity update and gate nothing
+    if (!my_kf.isStationary())
+    {
+        std_msgs::Int32MultiArray gating;
+        gating.data.resize(2);
+        my_kf.getGatingStats(gating.data[0], gating.data[1]);
+        pub_gating.publish(gating);
+    }
+
+    // active sliding window size, latched and only sent when the window deadline changed it
+    static int last_window_size = -1;
+    if (my_kf.getWindowSize() != last_window_size)
+    {
+        std_msgs::Int32 window_size;
+        window_size.data = last_window_size = my_kf.getWindowSize();
+        pub_window_size.publish(window_size);
+    }
+
+    sum_of_path += (my_kf.getPosition() - last_path).norm();
+    last_path = my_kf.getPosition();
+    //Matrix3d Rota = my_kf.getRotation();
+    //curr_q = R_to_quaternion(Rota.transpose());
+    //cout << curr_q << endl; 
+    //cout << curr_q.norm() << endl; 
+    curr_q = my_kf.getQuaternion();
+
+    ROS_INFO("sum of path %lf", sum_of_path);
+    ROS_INFO("vo solver costs: %lf ms", t_s.toc());
+
+    nav_msgs::Odometry odometry;
+    odometry.header.stamp = image_msg->header.stamp;
+    odometry.header.frame_id = "world";
+    odometry.pose.pose.position.x = last_path(0);
+    odometry.pose.pose.position.y = last_path(1);
+    odometry.pose.pose.position.z = last_path(2);
+    odometry.pose.pose.orientation.x = curr_q(1);
+    odometry.pose.pose.orientation.y = curr_q(2);
+    odometry.pose.pose.orientation.z = curr_q(3);
+    odometry.pose.pose.orientation.w = curr_q(0);
+//    odometry.twist.twist.linear.x = solution.v(0);
+//    odometry.twist.twist.linear.y = solution.v(1);
+//    odometry.twist.twist.linear.z = solution.v(2);
+    pub_odometry.publish(odometry);
+
+    // end to end, the header is the one of the camera image all the way through the tracker
+    std_msgs::Float64 latency;
+    latency.data = (ros::Time::now() - image_msg->header.stamp).toSec() * 1000.0;
+    pub_latency.publish(latency);
+    latency_sum += latency.data;
+    latency_max = max(latency_max, latency.data);
+    if (latency_report > 0 && ++latency_cnt == latency_report)
+    {
+        ROS_INFO("camera to odometry latency: mean %.2f ms, max %.2f ms over %d images",
+                 latency_sum / latency_cnt, latency_max, latency_cnt);
+        latency_cnt = 0;
+        latency_sum = latency_max = 0.0;
+    }
+
+//fprintf(f, "%lf %lf %lf %lf %lf %lf %lf %lf %lf %lf\n", solution.p(0), solution.p(1), solution.p(2),
+//        solution.v(0), solution.v(1), solution.v(2),
+//        solution.q.x(), solution.q.y(), solution.q.z(), solution.q.w());
+
+
+    geometry_msgs::PoseStamped pose_stamped;
+    pose_stamped.header.stamp = image_msg->header.stamp;
+    pose_stamped.header.frame_id = "world";
+    pose_stamped.pose = odometry.pose.pose;
+    path.poses.push_back(pose_stamped);
+    pub_path.publish(path);
+    pub_pose.publish(pose_stamped);
+
+    geometry_msgs::Point pose_p;
+    pose_p.x = last_path(0);
+    pose_p.y = last_path(1);
+    pose_p.z = last_path(2);
+
+    path_line.points.push_back(pose_p);
+    path_line.scale.x = 0.01;
+    pub_path1.publish(path_line);
+    path_line.scale.x = 0.5;
+    pub_path2.publish(path_line);
+
+    // broadcast tf
+
+    static tf::TransformBroadcaster br;
+    tf::Transform transform;
+    //transform.setOrigin(tf::Vector3(last_path(0), last_path(1), last_path(2)) );
+    tf::Quaternion q;
+    q.setW(curr_q(0));
+    q.setX(curr_q(1));
+    q.setY(curr_q(2));
+    q.setZ(curr_q(3));
+    transform.setRotation(q);
+    br.sendTransform(tf::StampedTransform(transform, ros::Time::now(), "world", "body"));
+
+//    transform.setOrigin(tf::Vector3(0.0, 0.0, 0.0));
+//    q.setEuler(0.0, M_PI, 0.0);
+//    transform.setRotation(q);
+//    br.sendTransform(tf::StampedTransform(transform, ros::Time::now(), "world", "world_v"));
+//    br.sendTransform(tf::StampedTransform(transform, ros::Time::now(), "body", "body_v"));
+
+}
+
+bool setup(ros::NodeHandle &n)
+{
+    // the state above is per process, a second instance would share it
+    if (is_setup.exchange(true))
+    {
+        ROS_FATAL("%s: only one msckf_vins instance per process, this one is not started", n.getNamespace().c_str());
+        return false;
+    }
+
+    // define pub topics
+    pub_path     = n.advertise<nav_msgs::Path>("path", 1000);
+    pub_path1    = n.advertise<visualization_msgs::Marker>("path1", 1000);
+    pub_path2    = n.advertise<visualization_msgs::Marker>("path2", 1000);
+    pub_odometry = n.advertise<nav_msgs::Odometry>("odometry", 1000);
+    pub_pose     = n.advertise<geometry_msgs::PoseStamped>("pose", 1000);
+    pub_pose2    = n.advertise<geometry_msgs::PoseStamped>("pose2", 1000);
+    pub_gating   = n.advertise<std_msgs::Int32MultiArray>("gating_stats", 1000);
+    pub_window_size = n.advertise<std_msgs::Int32>("window_size", 1, true);
+    pub_latency  = n.advertise<std_msgs::Float64>("latency", 1000);
+
+    static tf::TransformBroadcaster br;
+    tf::Transform transform;
+    tf::Quaternion q;
+
+//    transform.setOrigin(tf::Vector3(0.0, 0.0, 0.0));
+//    q.setEuler(0.0, M_PI, 0.0);
+//    transform.setRotation(q);
+//    br.sendTransform(tf::StampedTransform(transform, ros::Time::now(), "world", "world_v"));
+//    br.sendTransform(tf::StampedTransform(transform, ros::Time::now(), "body", "body_v"));
+
+
+    path_line.header.frame_id    = "world";
+    path_line.header.stamp       = ros::Time::now();
+    path_line.ns                 = "calibration";
+    path_line.action             = visualization_msgs::Marker::ADD;
+    path_line.pose.orientation.w = 1.0;
+    path_line.type               = visualization_msgs::Marker::LINE_STRIP;
+    path_line.scale.x            = 0.01;
+    path_line.color.a            = 1.0;
+    path_line.color.r            = 1.0;
+    path_line.id                 = 1;
+    path_line.points.push_back(geometry_msgs::Point());
+    pub_path1.publish(path_line);
+    path_line.scale.x            = 0.5;
+    pub_path2.publish(path_line);
+
+    path.header.frame_id = "world";
+
+    // init MSCKF
+    Vector4d init_q(1.0, 0.0, 0.0, 0.0);  // w x y z
+    Vector3d init_p(10.0, 0.0, 3.0);
+    Vector3d init_v(0.0, 1.0, 0.0);
+    Vector3d init_bg(0.0 ,0.0, 0.0);
+    Vector3d init_ba(0.0 ,0.0, 0.0);
+    Vector3d init_pcb(-0.14, -0.02, 0.0);
+
+    // intrinsics [fx, fy, ox, oy] and the distortion list of the compiled camera model,
+    // defaults are the radtan calibration of the right camera, other models default to
+    // their own distortion free parameters
+    vector<double> intrinsics, distortion;
+    if (!n.getParam("intrinsics", intrinsics) || intrinsics.size() != 4)
+        intrinsics = {365.07984, 365.12127, 381.0196, 254.4431};
+    if (!n.getParam("distortion", distortion))
+    {
+        if (is_same<CAMERA_MODEL, DistortCamera>::value)
+            distortion = {-2.842958e-1, 8.7155025e-2, -1.4602925e-4, -6.149638e-4, -1.218237e-2};
+        else
+            distortion = CAMERA_MODEL().getDistortionParam();
+    }
+    if (!my_kf.setCalibParam(init_pcb, intrinsics[0], intrinsics[1], intrinsics[2], intrinsics[3], distortion))
+    {
+        ROS_FATAL("%s camera model expects %d distortion parameters, got %lu",
+                  CAMERA_MODEL::name(), CAMERA_MODEL::NUM_DISTORTION_PARAM, distortion.size());
+        ros::shutdown();
+        return false;
+    }
+    my_kf.setNominalState(init_q, init_p, init_v, init_bg, init_ba);
+
+    // pixel noise of the tracked features
+    double measure_noise;
+    n.param("measure_noise", measure_noise, 1.0);
+    my_kf.setMeasureNoise(measure_noise);
+
+    // stereo: right camera intrinsics, distortion and the left -> right transform
+    // T_rl = [r00 r01 r02 t0; r10 r11 r12 t1; r20 r21 r22 t2] so that p_r = R_rl * p_l + t_rl
+    n.param("stereo", use_stereo, false);
+    if (use_stereo)
+    {
+        vector<double> right_intrinsics, right_distortion, T_rl;
+        if (n.getParam("right/intrinsics", right_intrinsics) && right_intrinsics.size() == 4 &&
+            n.getParam("right/distortion", right_distortion) &&
+            n.getParam("right/T_rl", T_rl) && T_rl.size() == 12)
+        {
+            Matrix3d R_rl;
+            Vector3d t_rl;
+            R_rl << T_rl[0], T_rl[1], T_rl[2],
+                    T_rl[4], T_rl[5], T_rl[6],
+                    T_rl[8], T_rl[9], T_rl[10];
+            t_rl << T_rl[3], T_rl[7], T_rl[11];
+            use_stereo = my_kf.setStereoCalibParam(right_intrinsics[0], right_intrinsics[1],
+                                                   right_intrinsics[2], right_intrinsics[3],
+                                                   right_distortion, R_rl, t_rl);
+        }
+        else
+        {
+            use_stereo = false;
+        }
+        if (!use_stereo)
+            ROS_ERROR("bad right camera calibration, running monocular");
+    }
+
+    // stereo features are usable after one frame, so the window can be shorter
+    int window_size;
+    n.param("window_size", window_size, use_stereo ? 6 : SLIDING_WINDOW_SIZE);
+    my_kf.setWindowSize(window_size);
+    // processImage deadline in ms, the window adapts to it, 0 keeps window_size; off by
+    // default, the wall clock makes the estimate depend on the machine load
+    double window_deadline;
+    n.param("window_deadline", window_deadline, 0.0);
+    my_kf.setWindowDeadline(window_deadline);
+
+    // per frame update budget, 0 disables the limit
+    int max_update_rows, selection_score;
+    double update_time_budget;
+    n.param("max_update_rows", max_update_rows, 0);
+    n.param("update_time_budget", update_time_budget, 0.0);
+    n.param("selection_score", selection_score, (int)SCORE_TRACE_REDUCTION);
+    my_kf.setUpdateBudget(max_update_rows, update_time_budget, selection_score);
+
+    double gating_confidence;
+    n.param("gating_confidence", gating_confidence, 0.95);
+    my_kf.setGatingConfidence(gating_confidence);
+
+    // SLAM landmarks for long tracks (hovering), 0 keeps the pure MSCKF
+    int max_landmarks;
+    n.param("max_landmarks", max_landmarks, 0);
+    my_kf.setLandmarkBudget(max_landmarks);
+
+    // keyframe thresholds of the sliding window, all 0 (default) keeps the FIFO window
+    double keyframe_rotation, keyframe_translation, keyframe_parallax;
+    n.param("keyframe_rotation", keyframe_rotation, 0.0);        // deg, e.g. 2
+    n.param("keyframe_translation", keyframe_translation, 0.0);  // m, e.g. 0.03
+    n.param("keyframe_parallax", keyframe_parallax, 0.0);        // px, e.g. 8
+    my_kf.setKeyframePolicy(keyframe_rotation * M_PI / 180.0, keyframe_translation, keyframe_parallax);
+
+    // zero velocity detection, zupt_imu_window 0 (default) disables it, e.g. 40 samples
+    int zupt_imu_window;
+    double zupt_acc_std, zupt_gyro_std, zupt_pixel_motion;
+    n.param("zupt_imu_window", zupt_imu_window, 0);
+    n.param("zupt_acc_std", zupt_acc_std, 0.05);        // m/s^2
+    n.param("zupt_gyro_std", zupt_gyro_std, 0.005);     // rad/s
+    n.param("zupt_pixel_motion", zupt_pixel_motion, 0.5);   // px
+    my_kf.setZuptConfig(zupt_imu_window, zupt_acc_std, zupt_gyro_std, zupt_pixel_motion);
+
+    int undistort_map_step;
+    string undistort_map_cache;
+    n.param("undistort_map_step", undistort_map_step, 4);
+    n.param("undistort_map_cache", undistort_map_cache, string(""));
+    my_kf.initUndistortMap(undistort_map_step, undistort_map_cache);
+
+    // latency summary every latency_report images, 0: only the "latency" topic
+    n.param("latency_report", latency_report, 100);
+
+    sub_imu   = n.subscribe("/imu_3dm_gx4/imu", 1000, imu_callback);
+    sub_image = n.subscribe("/sensors/image", 1000, image_callback);
+    return true;
+}
+
+} // namespace msckf_vins
+
+
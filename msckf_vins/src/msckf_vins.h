@@ -0,0 +1,22 @@
+//
+//  msckf_vins.h
+//  msckf_vins
+//
+//  filter front end, run by msckf_vins_node or by the nodelet
+//
+
+#ifndef MSCKF_VINS_H
+#define MSCKF_VINS_H
+
+#include <ros/ros.h>
+
+namespace msckf_vins
+{
+
+// reads the parameters of n and subscribes to the IMU and the features, the callbacks run on the queue of n.
+// The filter state is global to the process: false (and nothing started) on a second call
+bool setup(ros::NodeHandle &n);
+
+}
+
+#endif
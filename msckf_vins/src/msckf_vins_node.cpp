@@ -0,0 +1,13 @@
+#include "msckf_vins.h"
+
+int main(int argc, char **argv)
+{
+    ros::init(argc, argv, "msckf_vins");
+    ros::NodeHandle n("~");
+    ros::console::set_logger_level(ROSCONSOLE_DEFAULT_NAME, ros::console::levels::Debug);
+
+    msckf_vins::setup(n);
+    ros::spin();
+
+    return 0;
+}
@@ -0,0 +1,31 @@
+//
+//  msckf_vins_nodelet.cpp
+//  msckf_vins
+//
+//  the filter as a nodelet: in the same manager as the tracker the features
+//  arrive as the shared pointer the tracker published, without serialization.
+//  The filter state is global to the library, only the first instance
+//  loaded into a manager runs, later ones log a fatal error and stay idle.
+//
+
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+#include "msckf_vins.h"
+
+namespace msckf_vins
+{
+
+class MsckfVinsNodelet : public nodelet::Nodelet
+{
+private:
+    virtual void onInit()
+    {
+        // IMU and image callbacks share the private queue and never run concurrently
+        setup(getPrivateNodeHandle());
+    }
+};
+
+}
+
+PLUGINLIB_EXPORT_CLASS(msckf_vins::MsckfVinsNodelet, nodelet::Nodelet)
@@ -60,7 +60,7 @@ void test_Apr()
     Vector3d ba(0.0f ,0.0f, 0.0f);
     Vector3d pcb(0.0f ,0.0f, 0.0f);
     my_kf.setCalibParam(pcb, 365.07984, 365.12127, 381.0196, 254.4431,
-                            -2.842958e-1, 8.7155025e-2, -1.4602925e-4, -6.149638e-4, -1.218237e-2);
+                            {-2.842958e-1, 8.7155025e-2, -1.4602925e-4, -6.149638e-4, -1.218237e-2});
     my_kf.setNominalState(q, p, v, bg, ba);
     my_kf.printNominalState(true);
 
@@ -261,7 +261,7 @@ void KFtest()
     Vector3d ba(0.0f ,0.0f, 0.0f);
     Vector3d pcb(10.0f ,0.0f, 0.0f);
     my_kf.setCalibParam(pcb, 365.07984, 365.12127, 381.0196, 254.4431,
-                            -2.842958e-1, 8.7155025e-2, -1.4602925e-4, -6.149638e-4, -1.218237e-2);
+                            {-2.842958e-1, 8.7155025e-2, -1.4602925e-4, -6.149638e-4, -1.218237e-2});
     my_kf.setNominalState(q, p, v, bg, ba);
     my_kf.printNominalState(true);
     my_kf.printErrorCovariance(true);
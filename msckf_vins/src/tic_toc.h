@@ -1,9 +1,9 @@
 #ifndef TIC_TOC_H
 #define TIC_TOC_H
 
-#include <ctime>
-#include <cstdlib>
+#include <chrono>
 
+// wall time in ms
 class TicToc
 {
 public:
@@ -14,16 +14,19 @@ public:
 
     void tic()
     {
-        t = clock();
+        t = std::chrono::steady_clock::now();
     }
 
     double toc()
     {
-        sum += (clock() - t) / CLOCKS_PER_SEC * 1000;
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        sum += std::chrono::duration<double, std::milli>(now - t).count();
+        t = now;
         return sum;
     }
 private:
-    double sum, t;
+    double sum;
+    std::chrono::steady_clock::time_point t;
 };
 
 #endif
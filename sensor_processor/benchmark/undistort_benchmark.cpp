@@ -0,0 +1,103 @@
+//
+//  undistort_benchmark.cpp
+//  sensor_processor
+//
+//  per frame cost of the tracker front end, whole image remap + KLT on the
+//  undistorted image vs KLT on the raw image + sparse point undistortion,
+//  at the sensor resolution and scaled up
+//
+
+#include <cstdio>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/video/tracking.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+
+using namespace std;
+using namespace cv;
+
+const int NUM_FRAMES = 100;
+const int MAX_CNT = 50;
+const int MIN_DIST = 30;
+
+double ms_since(int64 t)
+{
+    return (getTickCount() - t) * 1000.0 / getTickFrequency();
+}
+
+// blurred noise, a shifted copy of it is the next frame
+Mat textured_image(int rows, int cols)
+{
+    Mat noise(rows, cols, CV_8UC1), img;
+    randu(noise, Scalar(0), Scalar(255));
+    GaussianBlur(noise, img, Size(0, 0), 3.0);
+    normalize(img, img, 0, 255, NORM_MINMAX);
+    return img;
+}
+
+void benchmark(int rows, int cols)
+{
+    // left camera of the stereo rig, intrinsics scaled with the resolution
+    double s = cols / 752.0;
+    Mat K = (Mat_<float>(3, 3) << 362.24997 * s, 0, 362.23343 * s,
+                                  0, 362.23819 * s, 230.08216 * s,
+                                  0, 0, 1);
+    Mat D = (Mat_<float>(1, 5) << -0.2813127, 0.0852533, -8.044631e-4, -2.353477e-4, -1.158103e-2);
+    Mat map1, map2;
+    initUndistortRectifyMap(K, D, Mat(), Mat(), Size(cols, rows), CV_32FC1, map1, map2);
+
+    Mat img0 = textured_image(rows, cols), img1;
+    Mat shift = (Mat_<double>(2, 3) << 1, 0, 2.5, 0, 1, 1.5);
+    warpAffine(img0, img1, shift, img0.size(), INTER_LINEAR, BORDER_REFLECT);
+
+    // the previous frame has been remapped already when the new one comes in
+    Mat un0, un1;
+    remap(img0, un0, map1, map2, INTER_LINEAR, BORDER_CONSTANT);
+
+    double t_remap = 0.0, t_image = 0.0, t_raw = 0.0, t_points = 0.0;
+    double checksum = 0.0;
+    for (int k = 0; k < NUM_FRAMES; k++)
+    {
+        vector<Point2f> pts, forw_pts, un_pts;
+        vector<uchar> status;
+        vector<float> err;
+
+        // undistorted image mode
+        int64 t = getTickCount();
+        remap(img1, un1, map1, map2, INTER_LINEAR, BORDER_CONSTANT);
+        t_remap += ms_since(t);
+        goodFeaturesToTrack(un0, pts, MAX_CNT * 2, 0.05, MIN_DIST);
+        calcOpticalFlowPyrLK(un0, un1, pts, forw_pts, status, err, Size(21, 21), 3);
+        if (!forw_pts.empty())
+            undistortPoints(forw_pts, un_pts, K, Mat());
+        t_image += ms_since(t);
+        checksum += un_pts.empty() ? 0.0 : un_pts[0].x;
+
+        // raw image mode
+        t = getTickCount();
+        goodFeaturesToTrack(img0, pts, MAX_CNT * 2, 0.05, MIN_DIST);
+        calcOpticalFlowPyrLK(img0, img1, pts, forw_pts, status, err, Size(21, 21), 3);
+        int64 t_p = getTickCount();
+        if (!forw_pts.empty())
+            undistortPoints(forw_pts, un_pts, K, D);
+        t_points += ms_since(t_p);
+        t_raw += ms_since(t);
+        checksum += un_pts.empty() ? 0.0 : un_pts[0].x;
+    }
+
+    printf("%4d x %4d  remap %6.2f ms  undistorted image %6.2f ms  raw image %6.2f ms (points %5.3f ms)  saved %6.2f ms/frame\n",
+           cols, rows, t_remap / NUM_FRAMES, t_image / NUM_FRAMES, t_raw / NUM_FRAMES, t_points / NUM_FRAMES,
+           (t_image - t_raw) / NUM_FRAMES);
+    printf("checksum %lf\n", checksum);
+}
+
+int main(int argc, char **argv)
+{
+    theRNG().state = 0;
+    benchmark(480, 752);
+    benchmark(720, 1280);
+    benchmark(1080, 1920);
+    return 0;
+}
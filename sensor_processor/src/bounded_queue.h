@@ -0,0 +1,75 @@
+//
+//  bounded_queue.h
+//  sensor_processor
+//
+//  FIFO between two pipeline stages, push blocks while the queue is full so a
+//  slow stage holds back the ones before it instead of dropping frames. The
+//  image callback pushes too, a slow tracker backs up into the subscriber
+//  queue and every image that gets there is processed.
+//
+
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+template<typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(int _capacity = 1): capacity(_capacity), closed(false)
+    {
+    }
+
+    void setCapacity(int _capacity)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        capacity = _capacity > 0 ? _capacity : 1;
+    }
+
+    // false if the queue has been closed
+    bool push(const T &item)
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        not_full.wait(lock, [this] { return closed || int(items.size()) < capacity; });
+        if (closed)
+            return false;
+        items.push_back(item);
+        not_empty.notify_one();
+        return true;
+    }
+
+    // false once the queue is closed and empty, depth is the number of items left behind
+    bool pop(T &item, int &depth)
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        not_empty.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty())
+            return false;
+        item = items.front();
+        items.pop_front();
+        depth = items.size();
+        not_full.notify_one();
+        return true;
+    }
+
+    // wakes up every waiting push and pop, the items left are still handed out
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        closed = true;
+        not_full.notify_all();
+        not_empty.notify_all();
+    }
+
+private:
+    std::deque<T> items;
+    int capacity;
+    bool closed;
+    std::mutex mtx;
+    std::condition_variable not_full, not_empty;
+};
+
+#endif
@@ -0,0 +1,1166 @@
+#include <cstdlib>
+#include <vector>
+#include <map>
+#include <deque>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <atomic>
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+#include <ros/ros.h>
+#include <ros/callback_queue.h>
+#include "sensor_msgs/Image.h"
+#include "sensor_msgs/image_encodings.h"
+#include "sensor_msgs/Imu.h"
+#include "vins_msgs/FeatureFrame.h"
+#include "vins_msgs/PipelineStats.h"
+#include "cv_bridge/cv_bridge.h"
+#include <message_filters/subscriber.h>
+#include <message_filters/synchronizer.h>
+#include <message_filters/sync_policies/approximate_time.h>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/video/tracking.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+using namespace cv;
+
+#include "sensor_processor.h"
+#include "bounded_queue.h"
+
+// everything in a namespace, the nodelet shares its process with the filter.
+// The state is namespace scope, so there is one tracker per process, see setup
+namespace sensor_processor
+{
+
+atomic<bool> is_setup(false);
+
+Mat K, D, map1, map2, map1_fixed, map2_fixed;
+
+// false: KLT and detection run on the raw image and only the tracked points are undistorted,
+// true: every image is remapped first with the fixed point maps, cropped to undistort_roi
+bool undistort_image = false;
+int undistort_stripes = 1;      // remap stripes run in parallel
+Rect undistort_roi;             // part of the undistorted image that is kept
+Mat K_undist, K_right_undist;   // camera matrices of the cropped undistorted images
+
+// per stage wall time, summed over the published frames
+enum Stage { STAGE_DECODE, STAGE_UNDISTORT, STAGE_PYRAMID, STAGE_KLT, STAGE_RANSAC, STAGE_DETECT, STAGE_STEREO, STAGE_PUBLISH, NUM_STAGES };
+const char *stage_name[NUM_STAGES] = {"decode", "undistort", "pyramid", "klt", "ransac", "detect", "stereo", "publish"};
+double stage_time[NUM_STAGES];
+int stage_frames = 0;
+int timing_report = 100;        // published frames per timing summary, 0: off
+
+// stereo: right camera and the left -> right transform, p_r = R_rl * p_l + t_rl
+bool use_stereo = false;
+Mat K_right, D_right, map1_right, map2_right;
+Matx33d E_rl;   // essential matrix, x_r^T * E_rl * x_l = 0
+double stereo_epipolar_thresh = 1.0;   // pixel
+const int MAX_CNT = 50;
+const int MIN_DIST = 30;
+const int ROW = 480;
+const int COL = 752;
+const double FREQ_TIME = 0.1;
+
+// new corners are only detected in the cells of this grid that hold fewer than their share of MAX_CNT
+int detect_grid_cols = 5, detect_grid_rows = 4;
+// absolute floor of the Shi-Tomasi score (min eigenvalue of the averaged Scharr structure tensor)
+double min_corner_score = 5000.0;
+
+// pyramids with Scharr derivatives, built once per image by the preprocess stage: forw_pyr
+// is tracked into, scored for new corners and then kept as cur_pyr for the next frame
+const Size WIN_SIZE(21, 21);
+const int PYR_LEVELS = 3;
+vector<Mat> cur_pyr, forw_pyr;
+// with the gyro prediction the points start close to their match, so KLT gets
+// a smaller window, fewer levels and fewer iterations
+bool imu_prediction = true;
+Size pred_win_size(15, 15);
+int pred_levels = 1;
+int pred_iterations = 10;
+Matx33d R_cb;   // body (IMU) -> camera, p_c = R_cb * p_b
+deque<pair<double, Vec3d> > gyro_buf;   // filled by the IMU callback, read by the track stage
+mutex gyro_mutex;
+// the IMU has its own queue and spinner, it keeps coming while the image callbacks are busy
+ros::CallbackQueue imu_queue;
+unique_ptr<ros::AsyncSpinner> imu_spinner;
+int track_lost = 0, track_predicted = 0;    // tracks lost / frames tracked with a prediction, since the last report
+
+// outlier rejection between the published images, the 2-point RANSAC needs the
+// gyro rotation over that interval and falls back to the fundamental matrix without it
+enum OutlierRejection
+{
+    REJECT_FUNDAMENTAL = 0, // 8-point fundamental matrix RANSAC on undistorted pixels
+    REJECT_TWO_POINT   = 1, // 2-point translation RANSAC on bearings rotated by the gyro
+    REJECT_COMPARE     = 2  // as 1, the fundamental matrix is run as well for the timing report
+};
+int outlier_rejection = REJECT_TWO_POINT;
+double two_point_thresh = 1.0;  // pixel
+Matx33d R_cur_prev;             // gyro rotation from the published image to the tracked one
+bool cur_rotation_valid = false;
+// per method since the last report
+double reject_time[2];
+int reject_runs[2], reject_inliers[2], reject_total[2], two_point_iterations = 0;
+vector<Point2f> prev_pts, cur_pts, forw_pts;
+double prev_time, cur_time, forw_time;
+
+int next_id = 0;
+vector<int> id;
+vector<int> track_cnt;  // published frames each feature has been tracked in
+
+// normalized coordinates of the last published frame, for the feature velocity
+map<int, Point2f> prev_un_pts_map;
+
+bool publish_track_info = true;     // track age and velocity in the feature message
+double preview_scale = 0.0;         // downscaled image on "preview", 0: not published
+
+ros::Publisher pub_image, pub_preview, pub_tracking;
+
+// the tracker in three stages, each on its own thread when pipeline is set and run in
+// a row in the image callback otherwise; every stage takes the frames in order, so the
+// output is the same either way
+enum PipeStage { PIPE_PREPROCESS, PIPE_TRACK, PIPE_OUTPUT, NUM_PIPE_STAGES };
+const char *pipe_stage_name[NUM_PIPE_STAGES] = {"preprocess", "track", "output"};
+
+// one image on its way through the pipeline, each stage fills its own fields
+struct Frame
+{
+    sensor_msgs::ImageConstPtr msg, right_msg;  // right_msg is empty in monocular mode
+    double time;
+    int64 t_received;
+
+    // preprocess: img may point into the message (toCvShare), cv keeps the message alive,
+    // images are never written after they are created
+    cv_bridge::CvImageConstPtr cv, right_cv;
+    Mat img, right_img;
+    vector<Mat> pyr, right_pyr;
+
+    // track, published frames only: the tracks after detection and, for the first
+    // prev_pts.size() of them, their position in the previous published frame
+    vector<Point2f> pts, prev_pts;
+    vector<int> ids, track_cnt;
+    double prev_time;
+
+    double stage_ms[NUM_STAGES];
+    double pipe_ms[NUM_PIPE_STAGES];
+    int queue_depth[NUM_PIPE_STAGES];
+};
+typedef shared_ptr<Frame> FramePtr;
+
+bool pipeline = true;
+BoundedQueue<FramePtr> pipe_queue[NUM_PIPE_STAGES];
+thread pipe_thread[NUM_PIPE_STAGES];
+ros::Publisher pub_pipeline_stats;
+double skipped_ms[NUM_STAGES];  // stage times of the frames not published, added to the next published one
+
+// annotated tracking image on "tracking", drawn and published by visualize_thread,
+// the output stage only hands over the latest frame
+bool visualize = false;
+double visualize_rate = 10.0;   // Hz, at most
+FramePtr vis_frame;
+bool vis_exit = false;
+double vis_last_time = 0.0;
+mutex vis_mutex;
+condition_variable vis_cond;
+
+// ms since t, t is moved to now
+double lap(int64 &t)
+{
+    int64 now = getTickCount();
+    double ms = (now - t) * 1000.0 / getTickFrequency();
+    t = now;
+    return ms;
+}
+
+void visualize_thread()
+{
+#ifdef __linux__
+    // lowest priority for this thread only, the tracker comes first
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+#endif
+    while (true)
+    {
+        FramePtr frame;
+        {
+            unique_lock<mutex> lock(vis_mutex);
+            vis_cond.wait(lock, [] { return vis_frame || vis_exit; });
+            if (vis_exit)
+                break;
+            frame.swap(vis_frame);
+        }
+
+        cv_bridge::CvImage tracking;
+        tracking.header = frame->msg->header;
+        tracking.encoding = sensor_msgs::image_encodings::BGR8;
+        cvtColor(frame->img, tracking.image, CV_GRAY2BGR);
+        for (int i = 0; i < int(frame->prev_pts.size()); i++)
+            line(tracking.image, frame->pts[i], frame->prev_pts[i], Scalar(0, 255, 0), 3);
+        for (int i = 0; i < int(frame->pts.size()); i++)
+            circle(tracking.image, frame->pts[i], 3, Scalar(0, 0, 255));
+        pub_tracking.publish(tracking.toImageMsg());
+    }
+}
+
+// fixed point remap of a range of horizontal stripes of the output
+class RemapStripes : public ParallelLoopBody
+{
+public:
+    RemapStripes(const Mat &_src, Mat &_dst, const Mat &_map1, const Mat &_map2, int _stripes):
+        src(_src), dst(_dst), stripe_map1(_map1), stripe_map2(_map2), stripes(_stripes)
+    {
+    }
+
+    void operator()(const Range &range) const
+    {
+        for (int i = range.start; i < range.end; i++)
+        {
+            int r0 = dst.rows * i / stripes, r1 = dst.rows * (i + 1) / stripes;
+            Mat dst_stripe = dst.rowRange(r0, r1);
+            remap(src, dst_stripe, stripe_map1.rowRange(r0, r1), stripe_map2.rowRange(r0, r1), INTER_LINEAR, BORDER_CONSTANT);
+        }
+    }
+
+private:
+    const Mat &src;
+    Mat &dst;
+    const Mat &stripe_map1, &stripe_map2;
+    int stripes;
+};
+
+// undistort (and crop) with CV_16SC2 maps, the output has the size of the maps
+void undistort_fixed(const Mat &src, Mat &dst, const Mat &_map1, const Mat &_map2)
+{
+    dst.create(_map1.size(), src.type());
+    if (undistort_stripes > 1)
+        parallel_for_(Range(0, undistort_stripes), RemapStripes(src, dst, _map1, _map2, undistort_stripes));
+    else
+        remap(src, dst, _map1, _map2, INTER_LINEAR, BORDER_CONSTANT);
+}
+
+template<typename T>
+void reduce_vector(vector<T> &v, vector<uchar> status)
+{
+    int j = 0;
+    for (int i = 0; i < int(v.size()); i++)
+        if (status[i])
+            v[j++] = v[i];
+    v.resize(j);
+}
+
+// normalized coordinates of points of the tracked image, the distortion is
+// removed here unless the whole image has been remapped already
+void undistort_points(const vector<Point2f> &pts, vector<Point2f> &un_pts, bool right = false)
+{
+    if (pts.empty())
+    {
+        un_pts.clear();
+        return;
+    }
+    if (undistort_image)
+        undistortPoints(pts, un_pts, right ? K_right_undist : K_undist, Mat());
+    else
+        undistortPoints(pts, un_pts, right ? K_right : K, right ? D_right : D);
+}
+
+// camera rotation from t0 to t1 by the buffered gyro samples, x_1 ~ R * x_0,
+// false if the samples do not cover [t0, t1] yet
+bool integrate_gyro(double t0, double t1, Matx33d &R)
+{
+    if (gyro_buf.size() < 2 || gyro_buf.front().first > t0 || gyro_buf.back().first < t1)
+        return false;
+    Matx33d R_b = Matx33d::eye();   // body at t1 in the body frame at t0
+    for (int i = 0; i + 1 < int(gyro_buf.size()); i++)
+    {
+        double a = max(gyro_buf[i].first, t0), b = min(gyro_buf[i + 1].first, t1);
+        if (b <= a)
+            continue;
+        Vec3d w = (gyro_buf[i].second + gyro_buf[i + 1].second) * 0.5;
+        Matx33d dR;
+        Rodrigues(w * (b - a), dR);
+        R_b = R_b * dR;
+    }
+    R = R_cb * R_b.t() * R_cb.t();
+    return true;
+}
+
+// RANSAC on normalized points with x_1 ~ R * x_0 + t, R known: two points give the
+// translation direction t = (R x_0 x x_1) x (R x'_0 x x'_1), inliers are within thresh
+// (normalized units) of their epipolar line, status as findFundamentalMat, returns the iterations
+int two_point_ransac(const vector<Point2f> &un_pts0, const vector<Point2f> &un_pts1, const Matx33d &R,
+                     double thresh, vector<uchar> &status)
+{
+    int n = un_pts0.size();
+    vector<Vec3d> rays0(n), rays1(n), normals(n);
+    for (int i = 0; i < n; i++)
+    {
+        rays0[i] = R * Vec3d(un_pts0[i].x, un_pts0[i].y, 1.0);
+        rays1[i] = Vec3d(un_pts1[i].x, un_pts1[i].y, 1.0);
+        normals[i] = rays0[i].cross(rays1[i]);
+    }
+
+    status.assign(n, 1);
+    if (n < 3)
+        return 0;
+
+    static RNG rng(0x12345);
+    const int MAX_ITERATIONS = 200;
+    const double CONFIDENCE = 0.99;
+    vector<uchar> cur_status(n);
+    int best_cnt = -1, max_iterations = MAX_ITERATIONS, iteration = 0;
+    for (; iteration < max_iterations; iteration++)
+    {
+        int a = rng.uniform(0, n), b = rng.uniform(0, n - 1);
+        if (b >= a)
+            b++;
+        Vec3d t = normals[a].cross(normals[b]);
+        double t_norm = norm(t);
+        if (t_norm < 1e-12)
+            continue;
+        t *= 1.0 / t_norm;
+
+        int cnt = 0;
+        for (int i = 0; i < n; i++)
+        {
+            Vec3d l = t.cross(rays0[i]);
+            double dist = fabs(l.dot(rays1[i])) / sqrt(l[0] * l[0] + l[1] * l[1] + 1e-18);
+            cur_status[i] = dist < thresh;
+            cnt += cur_status[i];
+        }
+        if (cnt > best_cnt)
+        {
+            best_cnt = cnt;
+            status = cur_status;
+            // enough iterations to draw an all inlier pair with CONFIDENCE
+            double w = double(cnt) / n;
+            if (w > 0.999)
+                break;
+            if (w > 0.0)
+                max_iterations = min(MAX_ITERATIONS, int(ceil(log(1.0 - CONFIDENCE) / log(1.0 - w * w))));
+        }
+    }
+    return iteration;
+}
+
+void add_rejection_stats(int method, double ms, const vector<uchar> &status)
+{
+    reject_time[method] += ms;
+    reject_runs[method]++;
+    reject_inliers[method] += countNonZero(status);
+    reject_total[method] += status.size();
+}
+
+// where the points of the tracked image move under the camera rotation R,
+// through the normalized plane so that the distortion is taken into account
+void predict_points(const vector<Point2f> &pts, const Matx33d &R, vector<Point2f> &pred_pts)
+{
+    vector<Point2f> un_pts;
+    undistort_points(pts, un_pts);
+    vector<Point3f> rays(un_pts.size());
+    for (int i = 0; i < int(un_pts.size()); i++)
+    {
+        Vec3d ray = R * Vec3d(un_pts[i].x, un_pts[i].y, 1.0);
+        rays[i] = Point3f(ray[0], ray[1], ray[2]);
+    }
+    pred_pts.clear();
+    if (!rays.empty())
+        projectPoints(rays, Vec3d::all(0.0), Vec3d::all(0.0), undistort_image ? K_undist : K,
+                      undistort_image ? Mat() : D, pred_pts);
+}
+
+// Shi-Tomasi scores (block size 3) in a cell of level 0 of a pyramid built with derivatives,
+// on the gradients KLT uses anyway: the local maxima of at least min_score where mask is set,
+// strongest first, and the best score of the cell
+void score_cell(const vector<Mat> &pyr, const Mat &mask, const Rect &cell, double min_score,
+                vector<pair<float, Point> > &candidates, double &max_score)
+{
+    candidates.clear();
+    // one pixel more for the box filter and the non maximum suppression
+    Rect area = Rect(cell.x - 2, cell.y - 2, cell.width + 4, cell.height + 4) & Rect(Point(0, 0), pyr[1].size());
+    Mat deriv[2], dx, dy;
+    split(pyr[1](area), deriv);
+    deriv[0].convertTo(dx, CV_32F);
+    deriv[1].convertTo(dy, CV_32F);
+
+    Mat a, b, c;
+    boxFilter(dx.mul(dx), a, CV_32F, Size(3, 3));
+    boxFilter(dx.mul(dy), b, CV_32F, Size(3, 3));
+    boxFilter(dy.mul(dy), c, CV_32F, Size(3, 3));
+    Mat half_diff = (a - c) * 0.5, root, eig;
+    magnitude(half_diff, b, root);
+    eig = (a + c) * 0.5 - root;
+
+    minMaxLoc(eig, 0, &max_score);
+    if (max_score < min_score)
+        return;
+    Mat local_max;
+    dilate(eig, local_max, Mat());
+
+    int y0 = max(cell.y, 1) - area.y, y1 = min(cell.y + cell.height, pyr[1].rows - 1) - area.y;
+    int x0 = max(cell.x, 1) - area.x, x1 = min(cell.x + cell.width, pyr[1].cols - 1) - area.x;
+    for (int y = y0; y < y1; y++)
+    {
+        const float *e = eig.ptr<float>(y), *m = local_max.ptr<float>(y);
+        const uchar *valid = mask.ptr<uchar>(y + area.y);
+        for (int x = x0; x < x1; x++)
+            if (e[x] >= min_score && e[x] == m[x] && valid[x + area.x])
+                candidates.push_back(make_pair(e[x], Point(x + area.x, y + area.y)));
+    }
+    sort(candidates.begin(), candidates.end(),
+         [](const pair<float, Point> &l, const pair<float, Point> &r) { return l.first > r.first; });
+}
+
+class ScoreCells : public ParallelLoopBody
+{
+public:
+    ScoreCells(const vector<Mat> &_pyr, const Mat &_mask, const vector<Rect> &_cells, double _min_score,
+               vector<vector<pair<float, Point> > > &_candidates, vector<double> &_max_score):
+        pyr(_pyr), mask(_mask), cells(_cells), min_score(_min_score), candidates(_candidates), max_score(_max_score)
+    {
+    }
+
+    void operator()(const Range &range) const
+    {
+        for (int i = range.start; i < range.end; i++)
+            score_cell(pyr, mask, cells[i], min_score, candidates[i], max_score[i]);
+    }
+
+private:
+    const vector<Mat> &pyr;
+    const Mat &mask;
+    const vector<Rect> &cells;
+    double min_score;
+    vector<vector<pair<float, Point> > > &candidates;
+    vector<double> &max_score;
+};
+
+// up to max_cnt - pts.size() new corners at least min_dist away from the tracked pts and
+// from each other, scored in parallel and only in the grid cells holding fewer than their
+// share of max_cnt tracks; a corner needs quality times the best score of all scored cells
+// and at least min_corner_score, so a textureless cell does not hand out its noise
+void detect_new_corners(const vector<Mat> &pyr, const vector<Point2f> &pts, vector<Point2f> &corners,
+                        int max_cnt, double quality, double min_dist)
+{
+    corners.clear();
+    int max_new = max_cnt - int(pts.size());
+    if (max_new <= 0)
+        return;
+    Size size = pyr[0].size();
+    int num_cells = detect_grid_cols * detect_grid_rows;
+    int quota = (max_cnt + num_cells - 1) / num_cells;
+
+    Mat mask(size, CV_8UC1, Scalar(255));
+    vector<int> cnt(num_cells, 0);
+    for (auto & p : pts)
+    {
+        circle(mask, p, int(min_dist), Scalar(0), -1);
+        int gx = min(max(int(p.x * detect_grid_cols / size.width), 0), detect_grid_cols - 1);
+        int gy = min(max(int(p.y * detect_grid_rows / size.height), 0), detect_grid_rows - 1);
+        cnt[gy * detect_grid_cols + gx]++;
+    }
+
+    vector<Rect> cells;
+    vector<int> need;
+    for (int gy = 0; gy < detect_grid_rows; gy++)
+        for (int gx = 0; gx < detect_grid_cols; gx++)
+            if (cnt[gy * detect_grid_cols + gx] < quota)
+            {
+                int x0 = size.width * gx / detect_grid_cols, x1 = size.width * (gx + 1) / detect_grid_cols;
+                int y0 = size.height * gy / detect_grid_rows, y1 = size.height * (gy + 1) / detect_grid_rows;
+                cells.push_back(Rect(x0, y0, x1 - x0, y1 - y0));
+                need.push_back(quota - cnt[gy * detect_grid_cols + gx]);
+            }
+    if (cells.empty())
+        return;
+
+    vector<vector<pair<float, Point> > > cell_candidates(cells.size());
+    vector<double> cell_max(cells.size(), 0.0);
+    parallel_for_(Range(0, int(cells.size())), ScoreCells(pyr, mask, cells, min_corner_score, cell_candidates, cell_max));
+
+    double min_score = max(quality * *max_element(cell_max.begin(), cell_max.end()), min_corner_score);
+    vector<pair<float, pair<int, Point> > > candidates;
+    for (int i = 0; i < int(cells.size()); i++)
+        for (auto & candidate : cell_candidates[i])
+        {
+            if (candidate.first < min_score)
+                break;
+            candidates.push_back(make_pair(candidate.first, make_pair(i, candidate.second)));
+        }
+    sort(candidates.begin(), candidates.end(),
+         [](const pair<float, pair<int, Point> > &l, const pair<float, pair<int, Point> > &r) { return l.first > r.first; });
+
+    // strongest first over all cells, the mask also keeps corners of neighbouring cells apart
+    for (auto & candidate : candidates)
+    {
+        int i = candidate.second.first;
+        Point p = candidate.second.second;
+        if (need[i] == 0 || !mask.at<uchar>(p))
+            continue;
+        corners.push_back(Point2f(p.x, p.y));
+        circle(mask, p, int(min_dist), Scalar(0), -1);
+        need[i]--;
+        if (int(corners.size()) == max_new)
+            break;
+    }
+}
+
+// same, back in pixels of the undistorted image, for the fundamental matrix test
+void undistort_pixels(const vector<Point2f> &pts, vector<Point2f> &un_pts)
+{
+    if (undistort_image || pts.empty())
+    {
+        un_pts = pts;
+        return;
+    }
+    undistortPoints(pts, un_pts, K, D, noArray(), K);
+}
+
+// match the published features into the right image, un_pts are the
+// normalized left coordinates, outputs are normalized right coordinates
+void match_stereo(const Frame &f, const vector<Point2f> &un_pts,
+                  vector<Point2f> &un_right_pts, vector<uchar> &right_status)
+{
+    vector<Point2f> right_pts;
+    vector<float> err;
+    un_right_pts.clear();
+    right_status.clear();
+    if (f.pts.empty())
+        return;
+    // the left pyramid is reused, the right one is only tracked into and has no derivatives
+    calcOpticalFlowPyrLK(f.pyr, f.right_pyr, f.pts, right_pts, right_status, err, WIN_SIZE, PYR_LEVELS);
+    undistort_points(right_pts, un_right_pts, true);
+
+    // reject by the distance to the epipolar line in the right image
+    double focal = K_right.at<float>(0, 0);
+    for (int i = 0; i < int(right_pts.size()); i++)
+    {
+        if (!right_status[i])
+            continue;
+        Vec3d l = E_rl * Vec3d(un_pts[i].x, un_pts[i].y, 1.0);
+        double dist = fabs(l[0] * un_right_pts[i].x + l[1] * un_right_pts[i].y + l[2]) / sqrt(l[0] * l[0] + l[1] * l[1]);
+        if (dist * focal > stereo_epipolar_thresh ||
+            right_pts[i].x < 0 || right_pts[i].x >= f.right_img.cols || right_pts[i].y < 0 || right_pts[i].y >= f.right_img.rows)
+            right_status[i] = 0;
+    }
+    ROS_DEBUG("stereo matched %d / %lu", countNonZero(right_status), right_pts.size());
+}
+
+// decode, undistort and build the pyramids, needs nothing from the other frames
+void preprocess_frame(Frame &f)
+{
+    int64 t_stage = getTickCount();
+
+    // no copy for mono8 images, the message buffer is only read
+    f.cv = cv_bridge::toCvShare(f.msg, sensor_msgs::image_encodings::MONO8);
+    f.stage_ms[STAGE_DECODE] += lap(t_stage);
+    //undistort(f.cv->image, f.img, K, D);
+    if (undistort_image)
+        undistort_fixed(f.cv->image, f.img, map1_fixed, map2_fixed);
+    else
+        f.img = f.cv->image;
+    f.stage_ms[STAGE_UNDISTORT] += lap(t_stage);
+
+    buildOpticalFlowPyramid(f.img, f.pyr, WIN_SIZE, PYR_LEVELS, true);
+    f.stage_ms[STAGE_PYRAMID] += lap(t_stage);
+
+    if (f.right_msg)
+    {
+        f.right_cv = cv_bridge::toCvShare(f.right_msg, sensor_msgs::image_encodings::MONO8);
+        if (undistort_image)
+            undistort_fixed(f.right_cv->image, f.right_img, map1_right, map2_right);
+        else
+            f.right_img = f.right_cv->image;
+        buildOpticalFlowPyramid(f.right_img, f.right_pyr, WIN_SIZE, PYR_LEVELS, false);
+        f.stage_ms[STAGE_STEREO] += lap(t_stage);
+    }
+}
+
+// KLT, outlier rejection and detection, the only stage with tracking state,
+// true if the frame is published
+bool track_frame(Frame &f)
+{
+    forw_time = f.time;
+    forw_pyr = f.pyr;
+    ROS_DEBUG("current time %lf", forw_time);
+    int64 t_stage = getTickCount();
+
+    if (cur_pyr.empty())
+    {
+        ROS_DEBUG("init");
+
+        detect_new_corners(forw_pyr, vector<Point2f>(), prev_pts, MAX_CNT, 0.05, MIN_DIST);
+        prev_time = forw_time;
+
+        for (int i = 0; i < int(prev_pts.size()); i++)
+        {
+            id.push_back(next_id++);
+            track_cnt.push_back(1);
+        }
+
+        ROS_DEBUG("feature number: %d", int(prev_pts.size()));
+
+        cur_pts = prev_pts;
+        cur_time = prev_time;
+        cur_pyr.swap(forw_pyr);
+        R_cur_prev = Matx33d::eye();
+        cur_rotation_valid = true;
+        return false;
+    }
+
+    ROS_DEBUG("start tracking");
+
+    vector<uchar> status;
+    vector<float> err;
+    forw_pts.clear();
+
+    ROS_DEBUG("tracking number: %lu", cur_pts.size());
+    Matx33d R_fc;
+    bool forw_rotation_valid;
+    {
+        lock_guard<mutex> lock(gyro_mutex);
+        forw_rotation_valid = integrate_gyro(cur_time, forw_time, R_fc);
+        // older samples are not needed any more, one is kept before the image
+        while (gyro_buf.size() > 1 && gyro_buf[1].first <= forw_time)
+            gyro_buf.pop_front();
+    }
+    Matx33d R_forw_prev = R_fc * R_cur_prev;
+    forw_rotation_valid = forw_rotation_valid && cur_rotation_valid;
+    if (imu_prediction && !cur_pts.empty() && forw_rotation_valid)
+    {
+        predict_points(cur_pts, R_fc, forw_pts);
+        calcOpticalFlowPyrLK(cur_pyr, forw_pyr, cur_pts, forw_pts, status, err, pred_win_size, pred_levels,
+                             TermCriteria(TermCriteria::COUNT + TermCriteria::EPS, pred_iterations, 0.01),
+                             OPTFLOW_USE_INITIAL_FLOW);
+        track_predicted++;
+    }
+    else
+    {
+        calcOpticalFlowPyrLK(cur_pyr, forw_pyr, cur_pts, forw_pts, status, err, WIN_SIZE, PYR_LEVELS);
+    }
+    track_lost += int(cur_pts.size()) - countNonZero(status);
+    reduce_vector(prev_pts, status);
+    reduce_vector(cur_pts, status);
+    reduce_vector(forw_pts, status);
+    reduce_vector(id, status);
+    reduce_vector(track_cnt, status);
+    f.stage_ms[STAGE_KLT] += lap(t_stage);
+    ROS_DEBUG("tracking number: %lu", forw_pts.size());
+
+    if (forw_time - prev_time < FREQ_TIME)
+    {
+        cur_pyr.swap(forw_pyr);
+        std::swap(cur_pts, forw_pts);
+        std::swap(cur_time, forw_time);
+        R_cur_prev = R_forw_prev;
+        cur_rotation_valid = forw_rotation_valid;
+        return false;
+    }
+
+    status.clear();
+    bool two_point = outlier_rejection != REJECT_FUNDAMENTAL && forw_rotation_valid;
+    if ((!two_point || outlier_rejection == REJECT_COMPARE) && prev_pts.size() >= 9)
+    {
+        int64 t_f = getTickCount();
+        // the epipolar constraint only holds without distortion
+        vector<Point2f> un_prev_pts, un_forw_pts;
+        undistort_pixels(prev_pts, un_prev_pts);
+        undistort_pixels(forw_pts, un_forw_pts);
+        findFundamentalMat(un_prev_pts, un_forw_pts, FM_RANSAC, 0.5, 0.99, status);
+        add_rejection_stats(REJECT_FUNDAMENTAL, lap(t_f), status);
+    }
+    if (two_point)
+    {
+        int64 t_r = getTickCount();
+        vector<Point2f> un_prev_pts, un_forw_pts;
+        undistort_points(prev_pts, un_prev_pts);
+        undistort_points(forw_pts, un_forw_pts);
+        two_point_iterations += two_point_ransac(un_prev_pts, un_forw_pts, R_forw_prev,
+                                                 two_point_thresh / K.at<float>(0, 0), status);
+        add_rejection_stats(REJECT_TWO_POINT, lap(t_r), status);
+    }
+    if (!status.empty())
+    {
+        reduce_vector(prev_pts, status);
+        reduce_vector(forw_pts, status);
+        reduce_vector(id, status);
+        reduce_vector(track_cnt, status);
+    }
+
+    f.stage_ms[STAGE_RANSAC] += lap(t_stage);
+
+    for (auto & n : track_cnt)
+        n++;
+
+    vector<Point2f> tmp_pts;
+    detect_new_corners(forw_pyr, forw_pts, tmp_pts, MAX_CNT, 0.05, MIN_DIST);
+    ROS_DEBUG("new features: %lu", tmp_pts.size());
+
+    f.prev_pts = prev_pts;
+    for (auto & i : tmp_pts)
+    {
+        forw_pts.push_back(i);
+        id.push_back(next_id++);
+        track_cnt.push_back(1);
+    }
+
+    f.stage_ms[STAGE_DETECT] += lap(t_stage);
+
+    // the tracking reports follow the timing report of the output stage
+    static int track_frames = 0;
+    if (timing_report > 0 && ++track_frames == timing_report)
+    {
+        ROS_INFO("tracks lost per published frame %.1f, %d frames tracked with the gyro prediction",
+                 double(track_lost) / track_frames, track_predicted);
+        for (int i = REJECT_FUNDAMENTAL; i <= REJECT_TWO_POINT; i++)
+        {
+            if (reject_runs[i])
+                ROS_INFO("%s: %.2f ms, %.1f%% inliers over %d frames", i == REJECT_FUNDAMENTAL ? "fundamental RANSAC" : "2-point RANSAC",
+                         reject_time[i] / reject_runs[i], 100.0 * reject_inliers[i] / max(reject_total[i], 1), reject_runs[i]);
+            if (i == REJECT_TWO_POINT && reject_runs[i])
+                ROS_INFO("2-point RANSAC: %.1f iterations", double(two_point_iterations) / reject_runs[i]);
+            reject_time[i] = 0.0;
+            reject_runs[i] = reject_inliers[i] = reject_total[i] = 0;
+        }
+        two_point_iterations = 0;
+        track_frames = 0;
+        track_lost = track_predicted = 0;
+    }
+
+    f.pts = forw_pts;
+    f.ids = id;
+    f.track_cnt = track_cnt;
+    f.prev_time = prev_time;
+
+    std::swap(prev_pts, forw_pts);
+    std::swap(prev_time, forw_time);
+
+    cur_pts = prev_pts;
+    cur_time = prev_time;
+    cur_pyr.swap(forw_pyr);
+    R_cur_prev = Matx33d::eye();
+    cur_rotation_valid = true;
+    return true;
+}
+
+// feature message, stereo matches, publishing and reports, works on the frame only
+void output_frame(Frame &f)
+{
+    int64 t_stage = getTickCount();
+
+    // integer ids and float coordinates only, a few kB per frame, published as a
+    // shared pointer so a filter nodelet in the same process gets it without a copy
+    vins_msgs::FeatureFramePtr feature(new vins_msgs::FeatureFrame);
+    feature->header = f.msg->header;
+    vector<Point2f> un_pts;
+    undistort_points(f.pts, un_pts);
+    double dt = f.time - f.prev_time;
+    map<int, Point2f> un_pts_map;
+    for (int i = 0; i < int(un_pts.size()); i++)
+    {
+        int p_id = f.ids[i];
+        feature->ids.push_back(p_id);
+        feature->x.push_back(un_pts[i].x);
+        feature->y.push_back(un_pts[i].y);
+
+        if (publish_track_info)
+        {
+            auto it = prev_un_pts_map.find(p_id);
+            Point2f vel(0.0f, 0.0f);
+            if (it != prev_un_pts_map.end() && dt > 0.0)
+                vel = (un_pts[i] - it->second) * (1.0 / dt);
+            feature->track_age.push_back(min(f.track_cnt[i], 65535));
+            feature->velocity_x.push_back(vel.x);
+            feature->velocity_y.push_back(vel.y);
+            un_pts_map[p_id] = un_pts[i];
+        }
+    }
+    prev_un_pts_map.swap(un_pts_map);
+
+    if (f.right_msg)
+    {
+        vector<Point2f> un_right_pts;
+        vector<uchar> right_status;
+        match_stereo(f, un_pts, un_right_pts, right_status);
+
+        for (int i = 0; i < int(un_pts.size()); i++)
+        {
+            bool valid = i < int(right_status.size()) && right_status[i];
+            feature->right_x.push_back(valid ? un_right_pts[i].x : 0.0f);
+            feature->right_y.push_back(valid ? un_right_pts[i].y : 0.0f);
+            feature->right_valid.push_back(valid);
+        }
+        f.stage_ms[STAGE_STEREO] += lap(t_stage);
+    }
+    pub_image.publish(feature);
+    f.stage_ms[STAGE_PUBLISH] += lap(t_stage);
+
+    // the skipped (not published) frames add to decode, undistort and klt as well
+    for (int i = 0; i < NUM_STAGES; i++)
+        stage_time[i] += f.stage_ms[i];
+    if (timing_report > 0 && ++stage_frames == timing_report)
+    {
+        char report[256];
+        int len = 0;
+        for (int i = 0; i < NUM_STAGES; i++)
+        {
+            len += snprintf(report + len, sizeof(report) - len, " %s %.2f", stage_name[i], stage_time[i] / stage_frames);
+            stage_time[i] = 0.0;
+        }
+        ROS_INFO("ms per published frame:%s", report);
+        stage_frames = 0;
+    }
+
+    if (preview_scale > 0.0 && pub_preview.getNumSubscribers() > 0)
+    {
+        cv_bridge::CvImage preview;
+        preview.header = f.msg->header;
+        preview.encoding = sensor_msgs::image_encodings::MONO8;
+        resize(f.img, preview.image, Size(), preview_scale, preview_scale, INTER_AREA);
+        pub_preview.publish(preview.toImageMsg());
+    }
+}
+
+// runs stage on f and passes it on, stats are published after the last stage
+void run_stage(int stage, const FramePtr &f, int depth)
+{
+    f->queue_depth[stage] = depth;
+    int64 t = getTickCount();
+    bool forward = true;
+    switch (stage)
+    {
+    case PIPE_PREPROCESS:
+        preprocess_frame(*f);
+        break;
+    case PIPE_TRACK:
+        forward = track_frame(*f);
+        if (!forward)
+        {
+            for (int i = 0; i < NUM_STAGES; i++)
+                skipped_ms[i] += f->stage_ms[i];
+        }
+        else
+        {
+            for (int i = 0; i < NUM_STAGES; i++)
+            {
+                f->stage_ms[i] += skipped_ms[i];
+                skipped_ms[i] = 0.0;
+            }
+        }
+        break;
+    case PIPE_OUTPUT:
+        output_frame(*f);
+        break;
+    }
+    f->pipe_ms[stage] = lap(t);
+    if (!forward)
+        return;
+
+    if (stage + 1 < NUM_PIPE_STAGES)
+    {
+        if (pipeline)
+            pipe_queue[stage + 1].push(f);
+        else
+            run_stage(stage + 1, f, 0);
+        return;
+    }
+
+    if (visualize && f->time - vis_last_time >= 1.0 / visualize_rate && pub_tracking.getNumSubscribers() > 0)
+    {
+        // a frame not drawn yet is replaced, the thread only ever draws the latest one
+        lock_guard<mutex> lock(vis_mutex);
+        vis_frame = f;
+        vis_last_time = f->time;
+        vis_cond.notify_one();
+    }
+
+    if (pub_pipeline_stats.getNumSubscribers() > 0)
+    {
+        vins_msgs::PipelineStatsPtr stats(new vins_msgs::PipelineStats);
+        stats->header = f->msg->header;
+        for (int i = 0; i < NUM_PIPE_STAGES; i++)
+        {
+            stats->stage.push_back(pipe_stage_name[i]);
+            stats->latency_ms.push_back(f->pipe_ms[i]);
+            stats->queue_depth.push_back(f->queue_depth[i]);
+        }
+        stats->total_ms = (getTickCount() - f->t_received) * 1000.0 / getTickFrequency();
+        pub_pipeline_stats.publish(stats);
+    }
+}
+
+void stage_thread(int stage)
+{
+    FramePtr f;
+    int depth;
+    while (pipe_queue[stage].pop(f, depth))
+        run_stage(stage, f, depth);
+    // let the stage after this one drain and stop as well
+    if (stage + 1 < NUM_PIPE_STAGES)
+        pipe_queue[stage + 1].close();
+}
+
+// right_msg is empty in monocular mode
+void process_image(const sensor_msgs::ImageConstPtr &image_msg, const sensor_msgs::ImageConstPtr &right_msg)
+{
+    FramePtr f(new Frame);
+    f->msg = image_msg;
+    f->right_msg = right_msg;
+    f->time = image_msg->header.stamp.toSec();
+    f->t_received = getTickCount();
+    f->prev_time = f->time;
+    fill(f->stage_ms, f->stage_ms + NUM_STAGES, 0.0);
+    fill(f->pipe_ms, f->pipe_ms + NUM_PIPE_STAGES, 0.0);
+    fill(f->queue_depth, f->queue_depth + NUM_PIPE_STAGES, 0);
+
+    if (pipeline)
+    {
+        // blocks while the pipeline is full, so which frames get published depends
+        // only on their timestamps and not on how the threads were scheduled
+        pipe_queue[PIPE_PREPROCESS].push(f);
+    }
+    else
+        run_stage(PIPE_PREPROCESS, f, 0);
+}
+
+void imu_callback(const sensor_msgs::ImuConstPtr &imu_msg)
+{
+    lock_guard<mutex> lock(gyro_mutex);
+    gyro_buf.push_back(make_pair(imu_msg->header.stamp.toSec(),
+                                 Vec3d(imu_msg->angular_velocity.x, imu_msg->angular_velocity.y, imu_msg->angular_velocity.z)));
+    // keep about a second if no image arrives
+    while (gyro_buf.size() > 1 && gyro_buf.back().first - gyro_buf.front().first > 1.0)
+        gyro_buf.pop_front();
+}
+
+void image_callback(const sensor_msgs::ImageConstPtr &image_msg)
+{
+    process_image(image_msg, sensor_msgs::ImageConstPtr());
+}
+
+void stereo_callback(const sensor_msgs::ImageConstPtr &left_msg, const sensor_msgs::ImageConstPtr &right_msg)
+{
+    process_image(left_msg, right_msg);
+}
+
+// K, D of a camera from the "<prefix>K" and "<prefix>D" parameters
+bool read_camera(ros::NodeHandle &n, const string &prefix, Mat &_K, Mat &_D)
+{
+    vector<double> k, d;
+    if (!n.getParam(prefix + "K", k) || k.size() != 9 || !n.getParam(prefix + "D", d))
+        return false;
+    _K = Mat(3, 3, CV_32FC1);
+    _D = Mat(1, d.size(), CV_32FC1);
+    for (int i = 0; i < 9; i++)
+        _K.at<float>(i / 3, i % 3) = k[i];
+    for (int i = 0; i < int(d.size()); i++)
+        _D.at<float>(0, i) = d[i];
+    return true;
+}
+
+
+
+typedef message_filters::sync_policies::ApproximateTime<sensor_msgs::Image, sensor_msgs::Image> StereoSyncPolicy;
+ros::Subscriber sub_image, sub_imu;
+unique_ptr<message_filters::Subscriber<sensor_msgs::Image> > sub_left, sub_right;
+unique_ptr<message_filters::Synchronizer<StereoSyncPolicy> > stereo_sync;
+thread vis_thread;
+
+bool setup(ros::NodeHandle &n)
+{
+    // the state above is per process, a second instance would share it
+    if (is_setup.exchange(true))
+    {
+        ROS_FATAL("%s: only one sensor_processor instance per process, this one is not started",
+                  n.getNamespace().c_str());
+        return false;
+    }
+
+    if (read_camera(n, "", K, D))
+    {
+        ROS_INFO_STREAM("K: " << K);
+        ROS_INFO_STREAM("D: " << D);
+    }
+    else
+    {
+        ROS_ERROR("Error K, D");
+    }
+
+    n.param("undistort_image", undistort_image, false);
+    n.param("undistort_stripes", undistort_stripes, getNumThreads());
+    n.param("timing_report", timing_report, 100);
+    // undistort_roi: [x, y, width, height] of the undistorted image to keep, the whole image by default
+    vector<int> roi;
+    undistort_roi = Rect(0, 0, COL, ROW);
+    if (n.getParam("undistort_roi", roi))
+    {
+        if (roi.size() == 4 && (Rect(roi[0], roi[1], roi[2], roi[3]) & undistort_roi) == Rect(roi[0], roi[1], roi[2], roi[3]) &&
+            roi[2] > 0 && roi[3] > 0)
+            undistort_roi = Rect(roi[0], roi[1], roi[2], roi[3]);
+        else
+            ROS_ERROR("undistort_roi must be [x, y, width, height] inside the image, using the whole image");
+    }
+
+    // the float maps only build the fixed point ones, which are cropped to the roi
+    initUndistortRectifyMap(K, D, Mat(), Mat(), Size(COL, ROW), CV_32FC1, map1, map2);
+    convertMaps(map1, map2, map1_fixed, map2_fixed, CV_16SC2);
+    map1_fixed = map1_fixed(undistort_roi).clone();
+    map2_fixed = map2_fixed(undistort_roi).clone();
+    K_undist = K.clone();
+    K_undist.at<float>(0, 2) -= undistort_roi.x;
+    K_undist.at<float>(1, 2) -= undistort_roi.y;
+
+    // stereo: right/K, right/D and T_rl = [R_rl | t_rl] row major, p_r = R_rl * p_l + t_rl
+    n.param("stereo", use_stereo, false);
+    n.param("stereo_epipolar_thresh", stereo_epipolar_thresh, 1.0);
+    vector<double> T_rl;
+    if (use_stereo)
+    {
+        if (read_camera(n, "right/", K_right, D_right) && n.getParam("T_rl", T_rl) && T_rl.size() == 12)
+        {
+            Matx33d R_rl(T_rl[0], T_rl[1], T_rl[2],
+                         T_rl[4], T_rl[5], T_rl[6],
+                         T_rl[8], T_rl[9], T_rl[10]);
+            Matx33d t_skew(      0, -T_rl[11],  T_rl[7],
+                           T_rl[11],         0, -T_rl[3],
+                           -T_rl[7],  T_rl[3],        0);
+            E_rl = t_skew * R_rl;
+            Mat map1_right_float, map2_right_float;
+            initUndistortRectifyMap(K_right, D_right, Mat(), Mat(), Size(COL, ROW), CV_32FC1, map1_right_float, map2_right_float);
+            convertMaps(map1_right_float, map2_right_float, map1_right, map2_right, CV_16SC2);
+            map1_right = map1_right(undistort_roi).clone();
+            map2_right = map2_right(undistort_roi).clone();
+            K_right_undist = K_right.clone();
+            K_right_undist.at<float>(0, 2) -= undistort_roi.x;
+            K_right_undist.at<float>(1, 2) -= undistort_roi.y;
+            ROS_INFO_STREAM("right K: " << K_right);
+            ROS_INFO_STREAM("right D: " << D_right);
+        }
+        else
+        {
+            ROS_ERROR("Error right camera or T_rl, running monocular");
+            use_stereo = false;
+        }
+    }
+
+    // gyro prediction of the tracked points, R_cb: body (IMU) -> camera rotation, row major
+    n.param("imu_prediction", imu_prediction, true);
+    int win;
+    n.param("predicted_win_size", win, 15);
+    pred_win_size = Size(win, win);
+    n.param("predicted_levels", pred_levels, 1);
+    n.param("predicted_iterations", pred_iterations, 10);
+    R_cb = Matx33d(0, -1, 0,
+                   0,  0, 1,
+                  -1,  0, 0);
+    vector<double> r_cb;
+    if (n.getParam("R_cb", r_cb))
+    {
+        if (r_cb.size() == 9)
+            R_cb = Matx33d(&r_cb[0]);
+        else
+            ROS_ERROR("R_cb must have 9 entries, using the default rotation");
+    }
+    if (win > WIN_SIZE.width || pred_levels > PYR_LEVELS)
+    {
+        ROS_ERROR("predicted_win_size and predicted_levels must not exceed %d and %d", WIN_SIZE.width, PYR_LEVELS);
+        pred_win_size = WIN_SIZE;
+        pred_levels = PYR_LEVELS;
+    }
+    // outlier_rejection: 0 fundamental matrix, 1 gyro aided 2-point, 2 both for comparison (2-point is used)
+    n.param("outlier_rejection", outlier_rejection, int(REJECT_TWO_POINT));
+    n.param("two_point_thresh", two_point_thresh, 1.0);
+
+    // detect_grid_cols x detect_grid_rows cells for the new corners
+    n.param("detect_grid_cols", detect_grid_cols, 5);
+    n.param("detect_grid_rows", detect_grid_rows, 4);
+    detect_grid_cols = max(detect_grid_cols, 1);
+    detect_grid_rows = max(detect_grid_rows, 1);
+    n.param("min_corner_score", min_corner_score, 5000.0);
+
+    n.param("publish_track_info", publish_track_info, true);
+    n.param("preview_scale", preview_scale, 0.0);
+
+    pub_image = n.advertise<vins_msgs::FeatureFrame>("output_image", 1000);
+    pub_preview = n.advertise<sensor_msgs::Image>("preview", 10);
+
+    // visualize: annotated tracking image on "tracking" at up to visualize_rate Hz
+    n.param("visualize", visualize, false);
+    n.param("visualize_rate", visualize_rate, 10.0);
+    if (visualize && visualize_rate > 0.0)
+    {
+        pub_tracking = n.advertise<sensor_msgs::Image>("tracking", 10);
+        vis_thread = thread(visualize_thread);
+    }
+    else
+    {
+        visualize = false;
+    }
+
+    // pipeline: preprocess, track and output on their own threads with
+    // pipeline_queue_size frames in front of each, false runs them in the callback
+    int queue_size;
+    n.param("pipeline", pipeline, true);
+    n.param("pipeline_queue_size", queue_size, 2);
+    pub_pipeline_stats = n.advertise<vins_msgs::PipelineStats>("pipeline_stats", 100);
+    if (pipeline)
+    {
+        for (int i = 0; i < NUM_PIPE_STAGES; i++)
+        {
+            pipe_queue[i].setCapacity(queue_size);
+            pipe_thread[i] = thread(stage_thread, i);
+        }
+    }
+
+    // subscribed last, the callbacks need everything above
+    if (imu_prediction || outlier_rejection != REJECT_FUNDAMENTAL)
+    {
+        ros::NodeHandle imu_n(n);
+        imu_n.setCallbackQueue(&imu_queue);
+        sub_imu = imu_n.subscribe("input_imu", 1000, imu_callback);
+        imu_spinner.reset(new ros::AsyncSpinner(1, &imu_queue));
+        imu_spinner->start();
+    }
+
+    if (use_stereo)
+    {
+        sub_left.reset(new message_filters::Subscriber<sensor_msgs::Image>(n, "input_image", 100));
+        sub_right.reset(new message_filters::Subscriber<sensor_msgs::Image>(n, "input_image_right", 100));
+        stereo_sync.reset(new message_filters::Synchronizer<StereoSyncPolicy>(StereoSyncPolicy(10), *sub_left, *sub_right));
+        stereo_sync->registerCallback(boost::bind(&stereo_callback, _1, _2));
+    }
+    else
+    {
+        sub_image = n.subscribe("input_image", 1000, image_callback);
+    }
+    return true;
+}
+
+void shutdown()
+{
+    if (imu_spinner)
+        imu_spinner->stop();
+    // the frames already queued are still processed, each stage closes the next one
+    pipe_queue[PIPE_PREPROCESS].close();
+    for (int i = 0; i < NUM_PIPE_STAGES; i++)
+        if (pipe_thread[i].joinable())
+            pipe_thread[i].join();
+
+    if (vis_thread.joinable())
+    {
+        {
+            lock_guard<mutex> lock(vis_mutex);
+            vis_exit = true;
+        }
+        vis_cond.notify_one();
+        vis_thread.join();
+    }
+}
+
+} // namespace sensor_processor
@@ -0,0 +1,24 @@
+//
+//  sensor_processor.h
+//  sensor_processor
+//
+//  feature tracker, run by sensor_processor_node or by the nodelet
+//
+
+#ifndef SENSOR_PROCESSOR_H
+#define SENSOR_PROCESSOR_H
+
+#include <ros/ros.h>
+
+namespace sensor_processor
+{
+
+// reads the parameters of n and starts tracking, the callbacks run on the queue of n.
+// The tracker state is global to the process: false (and nothing started) on a second call
+bool setup(ros::NodeHandle &n);
+// stops the visualization thread
+void shutdown();
+
+}
+
+#endif
@@ -0,0 +1,45 @@
+//
+//  sensor_processor_nodelet.cpp
+//  sensor_processor
+//
+//  the tracker as a nodelet: with the filter in the same manager, images
+//  come in and features go out as shared pointers, nothing is serialized.
+//  The tracker state is global to the library, only the first instance
+//  loaded into a manager runs, later ones log a fatal error and stay idle.
+//
+
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+#include "sensor_processor.h"
+
+namespace sensor_processor
+{
+
+class SensorProcessorNodelet : public nodelet::Nodelet
+{
+public:
+    SensorProcessorNodelet(): running(false)
+    {
+    }
+
+    ~SensorProcessorNodelet()
+    {
+        // an idle instance must not stop the one that runs
+        if (running)
+            shutdown();
+    }
+
+private:
+    bool running;
+
+    virtual void onInit()
+    {
+        // the private queue is served by one thread at a time, as with ros::spin
+        running = setup(getPrivateNodeHandle());
+    }
+};
+
+}
+
+PLUGINLIB_EXPORT_CLASS(sensor_processor::SensorProcessorNodelet, nodelet::Nodelet)